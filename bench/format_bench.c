@@ -0,0 +1,112 @@
+/**
+ * Benchmark of the completion formatting in the libclang shim. The shim is
+ * compiled in with the libclang functions replaced by fakes returning the
+ * chunks of a typical method completion.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include "../src/libclang/libclang.c"
+
+#define NUM_RESULTS 10000
+#define NUM_ROUNDS 50
+
+typedef struct
+{
+    enum CXCompletionChunkKind kind;
+    const char* text;
+} fake_chunk_t;
+
+static const fake_chunk_t CHUNKS[] = {
+    {CXCompletionChunk_ResultType, "std::vector<int>::size_type"},
+    {CXCompletionChunk_TypedText, "getTranslationUnitSize"},
+    {CXCompletionChunk_LeftParen, "("},
+    {CXCompletionChunk_Placeholder, "const std::string &name"},
+    {CXCompletionChunk_Comma, ", "},
+    {CXCompletionChunk_Placeholder, "unsigned int options"},
+    {CXCompletionChunk_RightParen, ")"},
+    {CXCompletionChunk_Informative, " const"},
+};
+
+#define NUM_CHUNKS (sizeof(CHUNKS) / sizeof(CHUNKS[0]))
+
+static unsigned fake_num_chunks(CXCompletionString string)
+{
+    return NUM_CHUNKS;
+}
+
+static CXString fake_chunk_text(CXCompletionString string, unsigned i)
+{
+    CXString result = {.data = CHUNKS[i].text, .private_flags = 0};
+    return result;
+}
+
+static enum CXCompletionChunkKind fake_chunk_kind(
+    CXCompletionString string, unsigned i)
+{
+    return CHUNKS[i].kind;
+}
+
+static unsigned fake_priority(CXCompletionString string)
+{
+    return 50;
+}
+
+static const char* fake_get_string(CXString string)
+{
+    return (const char*)string.data;
+}
+
+static void fake_dispose_string(CXString string)
+{
+}
+
+static void count_completion(completion_t* completion, unsigned i, void* ctx)
+{
+    *(unsigned*)ctx += completion->abbr[0] + completion->word[0];
+}
+
+static double elapsed_ns(struct timespec* begin, struct timespec* end)
+{
+    return (end->tv_sec - begin->tv_sec) * 1e9 +
+        (end->tv_nsec - begin->tv_nsec);
+}
+
+int main()
+{
+    libclang_t so = {0};
+    so.get_num_completion_chunks = &fake_num_chunks;
+    so.get_completion_chunk_text = &fake_chunk_text;
+    so.get_completion_chunk_kind = &fake_chunk_kind;
+    so.get_completion_priority = &fake_priority;
+    so.get_string = &fake_get_string;
+    so.dispose_string = &fake_dispose_string;
+
+    CXCompletionResult* items = calloc(NUM_RESULTS, sizeof(CXCompletionResult));
+    for (unsigned i = 0; i < NUM_RESULTS; ++i)
+    {
+        items[i].CursorKind = CXCursor_CXXMethod;
+        items[i].CompletionString = NULL;
+    }
+
+    completion_results_t results = {.Results = items, .NumResults = NUM_RESULTS};
+    unsigned checksum = 0;
+    struct timespec begin, end;
+
+    clock_gettime(CLOCK_MONOTONIC, &begin);
+    for (unsigned round = 0; round < NUM_ROUNDS; ++round)
+    {
+        libclang_completions_foreach(&so, &results, &checksum, &count_completion);
+    }
+    clock_gettime(CLOCK_MONOTONIC, &end);
+
+    double total = elapsed_ns(&begin, &end);
+    printf("BenchmarkFormatCompletion\t%u\t%.1f ns/op\t(checksum %u)\n",
+           NUM_RESULTS * NUM_ROUNDS, total / (NUM_RESULTS * NUM_ROUNDS),
+           checksum);
+
+    free(items);
+    return 0;
+}
@@ -3,10 +3,18 @@ if exists('g:neoide_loaded')
 endif
 
 let g:neoide_loaded = 1
+" Push the candidates with complete() instead of completefunc calling back.
+let g:neoide_complete_push = get(g:, 'neoide_complete_push', 1)
 let s:neoided_path =  expand('<sfile>:p:h:h') . '/bin/neoided'
 
 function! s:start_neoide(host) abort
-    return jobstart([s:neoided_path], {'rpc': v:true})
+    " neoided starts loading libclang before the first request, unless the
+    " clang workers load it
+    let l:env = {}
+    if exists('g:neoide_clang_libclang') && get(g:, 'neoide_clang_workers', 0) <= 0
+        let l:env['NEOIDE_LIBCLANG'] = g:neoide_clang_libclang
+    endif
+    return jobstart([s:neoided_path], {'rpc': v:true, 'env': l:env})
 endfunction
 
 function! s:init_go()
@@ -14,19 +22,44 @@ function! s:init_go()
     call remote#host#RegisterPlugin('neoided', '0', [
         \ {'type': 'function', 'name': '_neoide_bufenter', 'sync': 0, 'opts': {}},
         \ {'type': 'function', 'name': '_neoide_bufsave', 'sync': 0, 'opts': {}},
+        \ {'type': 'function', 'name': '_neoide_bufchanged', 'sync': 0, 'opts': {}},
         \ {'type': 'function', 'name': '_neoide_bufclose', 'sync': 0, 'opts': {}},
         \ {'type': 'function', 'name': '_neoide_find_completions', 'sync': 0, 'opts': {}},
         \ {'type': 'function', 'name': '_neoide_show_completions', 'sync': 1, 'opts': {}},
         \ {'type': 'function', 'name': '_neoide_get_completions', 'sync': 1, 'opts': {}},
+        \ {'type': 'function', 'name': '_neoide_stats', 'sync': 1, 'opts': {}},
+        \ {'type': 'function', 'name': '_neoide_memory', 'sync': 1, 'opts': {}},
+        \ {'type': 'function', 'name': '_neoide_trace_flush', 'sync': 1, 'opts': {}},
         \ {'type': 'function', 'name': '_neoide_find_defenition', 'sync': 1, 'opts': {}},
         \ {'type': 'function', 'name': '_neoide_find_declaration', 'sync': 1, 'opts': {}},
         \ {'type': 'function', 'name': '_neoide_find_references', 'sync': 1, 'opts': {}},
         \ {'type': 'function', 'name': '_neoide_find_assingments', 'sync': 1, 'opts': {}}
         \ ])
+
+    " start the daemon now rather than on the first request
+    call remote#host#Require('neoided')
 endfunction
 
 function! neoide#find_completsion() abort
-    call _neoide_find_completions(&filetype, getline("."))
+    call _neoide_find_completions(
+        \ &filetype, expand('%:p'), line('.'), getline('.'),
+        \ g:neoide_complete_push)
+endfunction
+
+" Full paths of the files visible in the current tab.
+function! s:visible_files() abort
+    return map(tabpagebuflist(), 'fnamemodify(bufname(v:val), '':p'')')
+endfunction
+
+function! neoide#bufsave() abort
+    call _neoide_bufsave(&filetype, expand('%:p'), s:visible_files())
+endfunction
+
+" Send the contents of the buffer if it is modified, so the files including
+" it are parsed and completed against them.
+function! neoide#bufchanged() abort
+    call _neoide_bufchanged(
+        \ &filetype, expand('%:p'), &modified ? getline(1, '$') : 0)
 endfunction
 
 function! neoide#completefunc(findstart, base) abort
@@ -40,7 +73,8 @@ endfunction
 
 function! neoide#force_popup() abort
     if !pumvisible()
-        call _neoide_show_completions(&filetype, col('.') + 1)
+        call _neoide_show_completions(
+            \ &filetype, col('.') + 1, g:neoide_complete_push)
     endif
 endfunction
 
@@ -51,6 +85,39 @@ function! neoide#show_popup(position)
     endif
 endfunction
 
+" Show the candidates pushed by neoided, unless the user left insert mode or
+" selected a candidate.
+function! neoide#complete(column, items) abort
+    if mode() !=# 'i'
+        return
+    endif
+    if pumvisible() && exists('*complete_info') &&
+        \ complete_info(['selected']).selected >= 0
+        return
+    endif
+    call complete(a:column, a:items)
+endfunction
+
+" Show the candidates updated after the popup was opened, unless the user
+" left insert mode or selected a candidate. The menu is replaced in place
+" with complete(), so it does not close and reopen.
+function! neoide#refresh_popup(position) abort
+    if mode() !=# 'i'
+        return
+    endif
+    if pumvisible()
+        if get(b:, 'complete_column', -1) != a:position
+            return
+        endif
+        if exists('*complete_info') && complete_info(['selected']).selected >= 0
+            return
+        endif
+    endif
+    let b:complete_column = a:position
+    let l:word = strpart(getline('.'), a:position, col('.') - 1 - a:position)
+    call complete(a:position + 1, _neoide_get_completions(l:word))
+endfunction
+
 function! neoide#cancel_popup()
     if pumvisible()
         return 1
@@ -59,6 +126,23 @@ function! neoide#cancel_popup()
     endif
 endfunction
 
+function! neoide#stats() abort
+    echo join(_neoide_stats(), "\n")
+endfunction
+
+function! neoide#memory() abort
+    echo join(_neoide_memory(), "\n")
+endfunction
+
+function! neoide#trace_flush() abort
+    let l:path = _neoide_trace_flush()
+    if l:path == ''
+        call neoide#info('tracing is disabled, set $NEOIDE_TRACE to enable it')
+    else
+        call neoide#info('trace written to ' . l:path)
+    endif
+endfunction
+
 function! neoide#error(message)
     echo "neoide [error]: " . a:message
 endfunction
@@ -72,15 +156,30 @@ function! s:init()
 
     set completefunc=neoide#completefunc
     set completeopt+=menuone
+    if g:neoide_complete_push
+        " complete() should not insert the first candidate
+        set completeopt+=noselect
+    endif
 
     augroup neoide
         autocmd!
         autocmd BufEnter <buffer> call _neoide_bufenter(&filetype, expand('%:p'))
-        autocmd BufLeave <buffer> call _neoide_bufclose(&filetype, expand('%:p'))
+        autocmd BufWritePost <buffer> call neoide#bufsave()
+        autocmd InsertLeave,BufLeave <buffer> call neoide#bufchanged()
+        autocmd BufUnload <buffer> call _neoide_bufclose(
+            \ getbufvar(str2nr(expand('<abuf>')), '&filetype'),
+            \ expand('<afile>:p'))
         autocmd TextChangedI <buffer> call neoide#find_completsion()
+        if g:neoide_complete_push && exists('##TextChangedP')
+            autocmd TextChangedP <buffer> call neoide#find_completsion()
+        endif
         autocmd CompleteDone <buffer> call neoide#cancel_popup()
     augroup END
 
+    command! NeoideStats call neoide#stats()
+    command! NeoideMemory call neoide#memory()
+    command! NeoideTraceFlush call neoide#trace_flush()
+
     inoremap <C-Space> <C-O>:call neoide#force_popup()<CR>
     inoremap <silent> <expr> <ESC> (neoide#cancel_popup() ? "<C-E>" : "<ESC>")
 
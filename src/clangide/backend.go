@@ -0,0 +1,378 @@
+/**
+ * Clang backends. The local backend owns libclang in the current process,
+ * the pool backend delegates to worker processes (see pool.go).
+ */
+package clangide
+
+import (
+    "errors"
+    "sort"
+    "sync"
+    "github.com/vbogretsov/neoide/src/libclang"
+    "github.com/vbogretsov/neoide/src/stats"
+    "github.com/vbogretsov/neoide/src/trace"
+    "github.com/vbogretsov/neoide/src/types"
+)
+
+/**
+ * Translation units storage addressed by the source file path.
+ */
+type Backend interface {
+    types.Closable
+    Version() (int, int)
+    // Parse and reparse return the files included by the unit, the work is
+    // scheduled with the priority provided. The unsaved files replace the
+    // files on disk.
+    Parse(
+        path string, flags []string, unsaved []libclang.UnsavedFile,
+        options int, priority int) ([]string, error)
+    Reparse(
+        path string, unsaved []libclang.UnsavedFile,
+        options int, priority int) ([]string, error)
+    Dispose(path string)
+    // Complete in the file path of the translation unit provided, which is
+    // either the file own unit or the unit of a file including it. The
+    // unsaved files are the other files modified.
+    Complete(
+        unit string, path string, options int, content string,
+        unsaved []libclang.UnsavedFile,
+        line int, column int) (*[]types.Completion, error)
+    // Statistics recorded outside of the current process.
+    Stats() []stats.Snapshot
+    // Memory used by the translation units, largest first.
+    Memory() []types.MemoryUsage
+}
+
+var (
+    memoryUsed = stats.NewGauge("clang.memory")
+    swaps      = stats.NewCounter("clang.swaps")
+)
+
+var errClosed = errors.New("clang backend is closed")
+
+/**
+ * Sort memory usages, largest first.
+ */
+func sortMemory(usages []types.MemoryUsage) []types.MemoryUsage {
+    sort.Slice(usages, func(i, j int) bool {
+        return usages[i].Total() > usages[j].Total()
+    })
+    return usages
+}
+
+/**
+ * Backend running libclang in the current process. Translation unit handles
+ * are not thread safe, so all the calls are serialized by the scheduler,
+ * completions first.
+ *
+ * In the double buffered mode the visible units are reparsed aside: a new
+ * unit is parsed in the staging index while the current one keeps serving
+ * completions, then the units are swapped.
+ */
+type Local struct {
+    sched       *Scheduler
+    lock        sync.Mutex
+    clang       *libclang.Clang
+    index       *libclang.Index
+    units       map[string]*libclang.TranslationUnit
+    flags       map[string][]string
+    generations map[string]uint64
+    generation  uint64
+    memory      map[string]types.MemoryUsage
+    double      bool
+    // held from the parse of a unit aside until its swap, and taken before
+    // the scheduler
+    staging     *libclang.Index
+    stagingLock sync.Mutex
+    closed      bool
+}
+
+func NewLocal(sopath string, double bool) (*Local, error) {
+    lib, err := openLibrary(sopath)
+
+    if err != nil {
+        return nil, err
+    }
+
+    local := &Local{
+        sched: NewScheduler(),
+        clang: lib.clang,
+        index: lib.takeIndex(),
+        units: make(map[string]*libclang.TranslationUnit),
+        flags: make(map[string][]string),
+        generations: make(map[string]uint64),
+        memory: make(map[string]types.MemoryUsage),
+        double: double}
+
+    if double {
+        local.staging = lib.clang.CreateIndex(1, 1)
+    }
+
+    return local, nil
+}
+
+func (local *Local) Close() {
+    local.stagingLock.Lock()
+    defer local.stagingLock.Unlock()
+    local.sched.Acquire(PriorityInteractive)
+    defer local.sched.Release()
+
+    local.closed = true
+    for path, tu := range local.units {
+        local.clang.CloseTu(tu)
+        local.forget(path)
+    }
+    local.units = nil
+    // the library is shared and stays loaded
+    local.clang.CloseIndex(local.index)
+    if local.staging != nil {
+        local.clang.CloseIndex(local.staging)
+    }
+}
+
+/**
+ * Set a new unit of the path provided. Called by the scheduled calls.
+ */
+func (local *Local) store(path string, tu *libclang.TranslationUnit) {
+    local.generation += 1
+    local.generations[path] = local.generation
+    local.units[path] = tu
+}
+
+func (local *Local) Stats() []stats.Snapshot {
+    return nil
+}
+
+func (local *Local) Version() (int, int) {
+    return local.clang.Version()
+}
+
+/**
+ * Files included by the translation unit provided, nil if unknown.
+ */
+func (local *Local) inclusions(tu *libclang.TranslationUnit) []string {
+    includes, ok := local.clang.Inclusions(tu)
+    if !ok {
+        return nil
+    }
+    return includes
+}
+
+/**
+ * Sample the memory used by the translation unit of the path provided.
+ * Called by the scheduled calls.
+ */
+func (local *Local) sample(path string, tu *libclang.TranslationUnit) {
+    usage, ok := local.clang.TuMemory(tu)
+    if !ok {
+        return
+    }
+    usage.Path = path
+
+    local.lock.Lock()
+    defer local.lock.Unlock()
+
+    memoryUsed.Add(int64(usage.Total()) - int64(local.memory[path].Total()))
+    local.memory[path] = usage
+}
+
+/**
+ * Drop the memory sample of the path provided.
+ */
+func (local *Local) forget(path string) {
+    local.lock.Lock()
+    defer local.lock.Unlock()
+
+    if usage, ok := local.memory[path]; ok {
+        memoryUsed.Add(-int64(usage.Total()))
+        delete(local.memory, path)
+    }
+}
+
+func (local *Local) Memory() []types.MemoryUsage {
+    local.lock.Lock()
+    defer local.lock.Unlock()
+
+    usages := make([]types.MemoryUsage, 0, len(local.memory))
+    for _, usage := range local.memory {
+        usages = append(usages, usage)
+    }
+    return sortMemory(usages)
+}
+
+func (local *Local) Parse(
+    path string, flags []string, unsaved []libclang.UnsavedFile,
+    options int, priority int) ([]string, error) {
+
+    array := libclang.ToCStrings(flags)
+    defer array.Free()
+
+    local.sched.Acquire(priority)
+    defer local.sched.Release()
+    defer trace.Begin("parse", "clang", trace.LaneClang, path).End()
+
+    if local.closed {
+        return nil, errClosed
+    }
+
+    if old, ok := local.units[path]; ok {
+        local.clang.CloseTu(old)
+        delete(local.units, path)
+        delete(local.generations, path)
+        local.forget(path)
+    }
+
+    tu := local.clang.ParseTu(local.index, path, array, unsaved, options)
+    if tu == nil {
+        return nil, errors.New("unable to parse " + path)
+    }
+
+    local.store(path, tu)
+    local.flags[path] = flags
+    local.sample(path, tu)
+    return local.inclusions(tu), nil
+}
+
+/**
+ * Reparse the unit of the path provided. Returns nil includes if there is
+ * no unit.
+ */
+func (local *Local) Reparse(
+    path string, unsaved []libclang.UnsavedFile,
+    options int, priority int) ([]string, error) {
+
+    if local.double && priority <= PriorityVisible {
+        return local.reparseAside(path, unsaved, options, priority)
+    }
+
+    local.sched.Acquire(priority)
+    defer local.sched.Release()
+    defer trace.Begin("reparse", "clang", trace.LaneClang, path).End()
+
+    if local.closed {
+        return nil, errClosed
+    }
+
+    tu, ok := local.units[path]
+    if !ok {
+        return nil, nil
+    }
+
+    local.clang.ReparseTu(tu, unsaved, options)
+    local.sample(path, tu)
+    return local.inclusions(tu), nil
+}
+
+/**
+ * Parse a new unit of the path provided while the current one serves the
+ * completions and swap them. Two units of the file are in memory during
+ * the parse.
+ */
+func (local *Local) reparseAside(
+    path string, unsaved []libclang.UnsavedFile,
+    options int, priority int) ([]string, error) {
+
+    local.sched.Acquire(priority)
+    _, ok := local.units[path]
+    flags := local.flags[path]
+    generation := local.generations[path]
+    local.sched.Release()
+
+    if !ok {
+        return nil, nil
+    }
+
+    array := libclang.ToCStrings(flags)
+    defer array.Free()
+
+    // the staging index is not closed until the unit is swapped
+    local.stagingLock.Lock()
+    defer local.stagingLock.Unlock()
+    if local.closed {
+        return nil, errClosed
+    }
+
+    span := trace.Begin("reparse_aside", "clang", trace.LaneClang, path)
+    tu := local.clang.ParseTu(local.staging, path, array, unsaved, options)
+    span.End()
+
+    if tu == nil {
+        return nil, errors.New("unable to parse " + path)
+    }
+
+    local.sched.Acquire(PriorityInteractive)
+    defer local.sched.Release()
+    defer trace.Begin("swap", "clang", trace.LaneClang, path).End()
+
+    // disposed or parsed again in the meantime
+    old, ok := local.units[path]
+    if !ok || local.generations[path] != generation {
+        local.clang.CloseTu(tu)
+        return nil, nil
+    }
+
+    local.store(path, tu)
+    local.clang.CloseTu(old)
+    local.sample(path, tu)
+    swaps.Add(1)
+    return local.inclusions(tu), nil
+}
+
+func (local *Local) Dispose(path string) {
+    local.sched.Acquire(PriorityVisible)
+    defer local.sched.Release()
+
+    if tu, ok := local.units[path]; ok {
+        local.clang.CloseTu(tu)
+        delete(local.units, path)
+        delete(local.generations, path)
+        delete(local.flags, path)
+        local.forget(path)
+    }
+}
+
+func (local *Local) Complete(
+    unit string, path string, options int, content string,
+    unsaved []libclang.UnsavedFile,
+    line int, column int) (*[]types.Completion, error) {
+
+    local.sched.Acquire(PriorityInteractive)
+    defer local.sched.Release()
+    defer trace.Begin("complete", "clang", trace.LaneClang, path).End()
+
+    if local.closed {
+        return nil, errClosed
+    }
+
+    tu, ok := local.units[unit]
+    if !ok {
+        return nil, nil
+    }
+
+    return local.clang.Complete(
+        tu, options, content, path, unsaved, line, column), nil
+}
+
+/**
+ * Get completions using the contents provided without copying them.
+ */
+func (local *Local) CompleteBuffer(
+    unit string, path string, options int, content []byte,
+    unsaved []libclang.UnsavedFile,
+    line int, column int) (*[]types.Completion, error) {
+
+    local.sched.Acquire(PriorityInteractive)
+    defer local.sched.Release()
+
+    if local.closed {
+        return nil, errClosed
+    }
+
+    tu, ok := local.units[unit]
+    if !ok {
+        return nil, nil
+    }
+
+    return local.clang.CompleteBuffer(
+        tu, options, content, path, unsaved, line, column), nil
+}
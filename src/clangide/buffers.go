@@ -0,0 +1,105 @@
+package clangide
+
+import (
+    "sync"
+    "github.com/vbogretsov/neoide/src/libclang"
+    "github.com/vbogretsov/neoide/src/stats"
+    "github.com/vbogretsov/neoide/src/types"
+)
+
+var modifiedFiles = stats.NewGauge("buffers.modified")
+
+/**
+ * Contents of the files modified in vim and not saved. They are passed to
+ * libclang instead of the files on disk when a unit including them is
+ * parsed, reparsed or completed.
+ */
+type Buffers struct {
+    lock  sync.Mutex
+    files map[string]string
+}
+
+func NewBuffers() *Buffers {
+    return &Buffers{files: map[string]string{}}
+}
+
+/**
+ * Set the contents of the file provided, or forget them if the file is not
+ * modified. False if nothing changed.
+ */
+func (buffers *Buffers) Set(path string, content string, modified bool) bool {
+    path = types.AbsPath(path)
+
+    buffers.lock.Lock()
+    defer buffers.lock.Unlock()
+
+    old, ok := buffers.files[path]
+    if !modified {
+        if ok {
+            delete(buffers.files, path)
+            modifiedFiles.Add(-1)
+        }
+        return ok
+    }
+
+    if ok && old == content {
+        return false
+    }
+    if !ok {
+        modifiedFiles.Add(1)
+    }
+    buffers.files[path] = content
+    return true
+}
+
+/**
+ * Contents of the file provided if it is modified.
+ */
+func (buffers *Buffers) Get(path string) (string, bool) {
+    buffers.lock.Lock()
+    defer buffers.lock.Unlock()
+
+    content, ok := buffers.files[path]
+    return content, ok
+}
+
+func (buffers *Buffers) Remove(path string) {
+    buffers.Set(path, "", false)
+}
+
+/**
+ * Unsaved files among the files provided except the one skipped, all the
+ * unsaved files if files is nil.
+ */
+func (buffers *Buffers) Unsaved(
+    files []string, skip string) []libclang.UnsavedFile {
+
+    buffers.lock.Lock()
+    defer buffers.lock.Unlock()
+
+    if len(buffers.files) == 0 {
+        return nil
+    }
+
+    unsaved := []libclang.UnsavedFile{}
+    add := func(path string, content string) {
+        if path != skip {
+            unsaved = append(unsaved, libclang.UnsavedFile{
+                Filename: path, Contents: content})
+        }
+    }
+
+    if files == nil {
+        for path, content := range buffers.files {
+            add(path, content)
+        }
+        return unsaved
+    }
+
+    for _, path := range files {
+        if content, ok := buffers.files[path]; ok {
+            add(path, content)
+        }
+    }
+    return unsaved
+}
@@ -6,15 +6,21 @@
 package clangide
 
 import (
-    "regexp"
+    "fmt"
+    "io/ioutil"
+    "strings"
+    "sync"
+    "time"
     "github.com/vbogretsov/neoide/src/libclang"
+    "github.com/vbogretsov/neoide/src/stats"
     "github.com/vbogretsov/neoide/src/types"
-    "github.com/neovim/go-client/nvim"
 )
 
 var (
-    Trigger = regexp.MustCompile(`([\w_]+(\:\:|\.|->)$)`)
-    NewWord = regexp.MustCompile(`[^\w_\.][[:alpha:]_]$`)
+    backendTime = stats.NewHistogram("backend.complete")
+    pending     = stats.NewGauge("clang.pending")
+    noMacros    = stats.NewCounter("complete.nomacros")
+    noPatterns  = stats.NewCounter("complete.nopatterns")
 )
 
 const ParseOptions =
@@ -25,105 +31,526 @@ const ParseOptions =
 const CompleteOptions =
     libclang.CCIncludeMacros | libclang.CCIncludeCodePatterns
 
-func createIde(vim *nvim.Nvim, vimflags string) (types.Plugin, error) {
-    batch := vim.NewBatch()
+/**
+ * Text of the line provided, 1 based, empty if out of the content.
+ */
+func lineAt(content string, line int) string {
+    start := 0
+    for i := 1; i < line; i++ {
+        next := strings.IndexByte(content[start:], '\n')
+        if next < 0 {
+            return ""
+        }
+        start += next + 1
+    }
+
+    if end := strings.IndexByte(content[start:], '\n'); end >= 0 {
+        return content[start:start + end]
+    }
+    return content[start:]
+}
+
+/**
+ * Completion options for the context of the column provided. Macros are
+ * requested in the preprocessor conditionals and if the word typed starts
+ * upper case, code patterns only in the statements. The system headers
+ * define thousands of macros, so most of the requests skip them.
+ */
+func completeOptions(text string, column int, directive string) int {
+    if column < 1 || column - 1 > len(text) {
+        return CompleteOptions
+    }
+
+    before := strings.TrimRight(text[:column - 1], " \t")
+    typed := text[column - 1:]
+    scoped := strings.HasSuffix(before, ".") ||
+        strings.HasSuffix(before, "->") ||
+        strings.HasSuffix(before, "::")
+
+    switch directive {
+    case "":
+    case "if", "ifdef", "ifndef", "elif", "elifdef", "elifndef", "undef",
+        "define":
+        return libclang.CCIncludeMacros
+    default:
+        return 0
+    }
+
+    options := CompleteOptions
+
+    if scoped || typed == "" || typed[0] < 'A' || typed[0] > 'Z' {
+        options &^= libclang.CCIncludeMacros
+        noMacros.Add(1)
+    }
+    if scoped {
+        options &^= libclang.CCIncludeCodePatterns
+        noPatterns.Add(1)
+    }
+    return options
+}
+
+/**
+ * Parse options supported by the libclang loaded. Every unit parsed is a
+ * file open in the editor, so the function bodies outside the preamble are
+ * kept for the completions in them.
+ */
+type Options struct {
+    Primary int
+}
+
+func version(major int, minor int) int {
+    return major * 100 + minor
+}
+
+func SupportedOptions(major int, minor int) *Options {
+    current := version(major, minor)
+    primary := ParseOptions
+
+    if current >= version(3, 9) {
+        primary |= libclang.TUCreatePreambleOnFirstParse
+    }
+    if current >= version(5, 0) {
+        primary |= libclang.TUKeepGoing
+    }
 
+    if current >= version(6, 0) {
+        primary |=
+            libclang.TUSkipFunctionBodies |
+            libclang.TULimitSkipFunctionBodiesToPreamble
+    }
+
+    types.LOG.Printf(
+        "libclang %d.%d, parse options 0x%x\n", major, minor, primary)
+
+    return &Options{Primary: primary}
+}
+
+func createIde(vim types.Vim, vimflags string) (types.Plugin, error) {
     var libclang_path string
     var flags []string
-
-    batch.Call("eval", &libclang_path, "g:neoide_clang_libclang")
-    batch.Call("eval", &flags, vimflags)
-    err := batch.Execute()
+    var workers int
+    var double int
+
+    err := vim.Batch(
+        &types.VimCall{"eval", &libclang_path, []interface{}{
+            "g:neoide_clang_libclang"}},
+        &types.VimCall{"eval", &flags, []interface{}{vimflags}},
+        &types.VimCall{"eval", &workers, []interface{}{
+            "get(g:, 'neoide_clang_workers', 0)"}},
+        &types.VimCall{"eval", &double, []interface{}{
+            "get(g:, 'neoide_clang_double_buffer', 0)"}})
 
     if err != nil {
         return nil, err
     }
 
-    return New(libclang_path, flags)
+    return New(libclang_path, flags, workers, double != 0)
 }
 
-func CreateCIde(vim *nvim.Nvim) (types.Plugin, error) {
+func CreateCIde(vim types.Vim) (types.Plugin, error) {
     return createIde(vim, "g:neoide_c_flags")
 }
 
-func CreateCppIde(vim *nvim.Nvim) (types.Plugin, error) {
+func CreateCppIde(vim types.Vim) (types.Plugin, error) {
     return createIde(vim, "g:neoide_cpp_flags")
 }
 
+/**
+ * Clang backend shared by the IDEs created for the same libclang and number
+ * of workers: the C and C++ IDEs use one index, one set of translation
+ * units and one worker pool.
+ */
+type service struct {
+    key      string
+    backend  Backend
+    opts     *Options
+    graph    *IncludeGraph
+    reparser *Reparser
+    watcher  *Watcher
+    scopes   *ScopeCache
+    buffers  *Buffers
+    refs     int
+}
+
+var (
+    servicesLock sync.Mutex
+    services     = map[string]*service{}
+)
+
+func acquireService(
+    sopath string, workers int, double bool) (*service, error) {
+
+    servicesLock.Lock()
+    defer servicesLock.Unlock()
+
+    key := fmt.Sprintf("%s:%d:%t", sopath, workers, double)
+    if srv, ok := services[key]; ok {
+        srv.refs += 1
+        return srv, nil
+    }
+
+    var backend Backend
+    var err error
+
+    if workers > 0 {
+        releaseIndex(sopath)
+        backend, err = NewPool(sopath, workers, double)
+    } else {
+        backend, err = NewLocal(sopath, double)
+    }
+
+    if err != nil {
+        return nil, err
+    }
+
+    opts := SupportedOptions(backend.Version())
+    graph := NewIncludeGraph()
+    buffers := NewBuffers()
+
+    srv := &service{
+        key: key,
+        backend: backend,
+        opts: opts,
+        graph: graph,
+        reparser: NewReparser(backend, graph, buffers, opts.Primary),
+        scopes: NewScopeCache(),
+        buffers: buffers,
+        refs: 1}
+
+    // the changes made outside of the editor
+    srv.watcher, err = NewWatcher(srv.changed)
+    if err != nil {
+        types.LOG.Println(err)
+    } else {
+        graph.Listen(srv.watcher.Add)
+    }
+
+    services[key] = srv
+    return srv, nil
+}
+
+/**
+ * Reparse the units affected by the files changed, all of them if paths is
+ * nil.
+ */
+func (srv *service) changed(paths []string, changed time.Time) {
+    if paths == nil {
+        srv.scopes.Clear()
+        srv.reparser.ScheduleChanged(srv.graph.Units(), changed)
+        return
+    }
+
+    units := map[string]bool{}
+    for _, path := range paths {
+        srv.scopes.Invalidate(path)
+        if srv.graph.Has(path) {
+            units[path] = true
+        }
+        for _, unit := range srv.graph.Includers(path) {
+            units[unit] = true
+        }
+    }
+
+    affected := make([]string, 0, len(units))
+    for unit := range units {
+        affected = append(affected, unit)
+    }
+    srv.reparser.ScheduleChanged(affected, changed)
+}
+
+func (srv *service) release() {
+    servicesLock.Lock()
+    defer servicesLock.Unlock()
+
+    srv.refs -= 1
+    if srv.refs == 0 {
+        delete(services, srv.key)
+        if srv.watcher != nil {
+            srv.watcher.Close()
+        }
+        srv.reparser.Close()
+        srv.backend.Close()
+    }
+}
+
+/**
+ * IDE front for a language, the IDEs differ only in the flags.
+ */
 type Ide struct {
-    clang *libclang.Clang
-    index *libclang.Index
-    flags *libclang.CStrings
-    units map[string]*libclang.TranslationUnit
+    service *service
+    backend Backend
+    opts    *Options
+    graph   *IncludeGraph
+    flags   []string
+    lock    sync.Mutex
+    lexes   map[string]*Lexer
 }
 
-func New(sopath string, flags []string) (*Ide, error) {
-    clang, err := libclang.Load(sopath)
+/**
+ * Create IDE for the flags provided. If workers is positive, libclang runs
+ * in the number of worker processes provided, otherwise in this process.
+ * If double is set, the visible files are reparsed in double buffered
+ * units. The backend is shared with the other IDEs using the same libclang.
+ */
+func New(
+    sopath string, flags []string, workers int, double bool) (*Ide, error) {
 
+    srv, err := acquireService(sopath, workers, double)
     if err != nil {
         return nil, err
     }
 
-    index := clang.CreateIndex(1, 1)
-    units := make(map[string]*libclang.TranslationUnit)
-    array := libclang.ToCStrings(flags)
+    lexes := make(map[string]*Lexer)
 
-    return &Ide{clang: clang, flags: array, index: index, units: units}, nil
+    return &Ide{
+        service: srv,
+        backend: srv.backend,
+        opts: srv.opts,
+        graph: srv.graph,
+        flags: flags,
+        lexes: lexes}, nil
 }
 
 func (ide *Ide) Close() {
-    for _, tu := range ide.units {
-        ide.clang.CloseTu(tu)
-    }
-    ide.flags.Free()
-    ide.clang.Close()
+    ide.service.release()
+}
+
+/**
+ * IDEs with the same key share the backend, its statistics and memory.
+ */
+func (ide *Ide) SharedKey() interface{} {
+    return ide.service
+}
+
+/**
+ * Statistics recorded by the clang workers.
+ */
+func (ide *Ide) Stats() []stats.Snapshot {
+    return ide.backend.Stats()
+}
+
+/**
+ * Memory used by the translation units, largest first.
+ */
+func (ide *Ide) Memory() []types.MemoryUsage {
+    return ide.backend.Memory()
 }
 
+/**
+ * Parse the file provided. A header included by a unit already parsed is
+ * not parsed, it is completed in the unit of its includer.
+ */
 func (ide *Ide) Enter(path string, action func()) {
-    if old, ok := ide.units[path]; ok {
-        ide.clang.CloseTu(old)
+    pending.Add(1)
+    defer pending.Add(-1)
+
+    ide.scan(path, "", false)
+
+    if isHeader(path) && len(ide.graph.Includers(path)) > 0 {
+        action()
+        return
     }
 
-    ide.units[path] = ide.clang.ParseTu(
-        ide.index, path, ide.flags, ParseOptions)
+    // the files included are not known yet, all the unsaved ones are passed
+    includes, err := ide.backend.Parse(
+        path, ide.flags, ide.service.buffers.Unsaved(nil, ""),
+        ide.opts.Primary, PriorityVisible)
+    if err != nil {
+        types.LOG.Println(err)
+        return
+    }
+    ide.graph.Update(path, includes)
     action()
 }
 
+/**
+ * Set the files visible in the editor, their units are reparsed first.
+ */
+func (ide *Ide) Visible(paths []string) {
+    ide.service.reparser.Visible(paths)
+}
+
+/**
+ * Reparse the unit of the file saved and schedule background reparses of
+ * the units including it.
+ */
 func (ide *Ide) Save(path string, action func()) {
-    if tu, ok := ide.units[path]; ok {
-        ide.clang.ReparseTu(tu, ParseOptions)
-        action()
+    pending.Add(1)
+    defer pending.Add(-1)
+
+    ide.scan(path, "", false)
+    ide.service.buffers.Remove(path)
+    ide.service.scopes.Invalidate(path)
+    ide.service.reparser.Schedule(ide.graph.Includers(path))
+
+    if ide.graph.Has(path) {
+        ide.service.reparser.Mark(path)
+        unsaved := ide.service.buffers.Unsaved(ide.graph.Includes(path), "")
+        includes, err := ide.backend.Reparse(
+            path, unsaved, ide.opts.Primary, PriorityVisible)
+        if err != nil {
+            types.LOG.Println(err)
+            return
+        }
+        if includes != nil {
+            ide.graph.Update(path, includes)
+        }
+    }
+    action()
+}
+
+/**
+ * Keep the contents of the file modified and not saved, or forget them if
+ * the file is not modified. The units including the file are reparsed in
+ * background with the contents.
+ */
+func (ide *Ide) Changed(path string, content string, modified bool) {
+    ide.scan(path, content, modified)
+    if !ide.service.buffers.Set(path, content, modified) {
+        return
     }
+    ide.service.scopes.Invalidate(path)
+    ide.service.reparser.Schedule(ide.graph.Includers(path))
 }
 
 func (ide *Ide) Leave(path string, action func()) {
-    if tu, ok := ide.units[path]; ok {
-        ide.clang.CloseTu(tu)
-        action()
+    ide.lock.Lock()
+    delete(ide.lexes, path)
+    ide.lock.Unlock()
+
+    ide.service.buffers.Remove(path)
+
+    if ide.graph.Has(path) {
+        ide.graph.Remove(path)
+        ide.service.reparser.Forget(path)
+        ide.backend.Dispose(path)
+    }
+    action()
+}
+
+/**
+ * Scan the buffer of the file provided for the lexer, the file is read if
+ * it is not modified.
+ */
+func (ide *Ide) scan(path string, content string, modified bool) {
+    if !modified {
+        data, err := ioutil.ReadFile(path)
+        if err != nil {
+            return
+        }
+        content = string(data)
+    }
+
+    ide.lock.Lock()
+    defer ide.lock.Unlock()
+
+    lexer, ok := ide.lexes[path]
+    if !ok {
+        lexer = NewLexer()
+        ide.lexes[path] = lexer
     }
+    lexer.Scan(content)
 }
 
-func (ide *Ide) CanComplete(line string) int {
-    triggerMatch := Trigger.FindStringIndex(line)
-    if triggerMatch != nil {
-        return triggerMatch[1] + 1
+func (ide *Ide) CanComplete(location *types.Location, line string) int {
+    ide.lock.Lock()
+    defer ide.lock.Unlock()
+
+    lexer, ok := ide.lexes[location.Path]
+    if !ok {
+        lexer = NewLexer()
+        ide.lexes[location.Path] = lexer
     }
-    newWordMatch := NewWord.FindStringIndex(line)
-    if newWordMatch != nil {
-        return newWordMatch[1]
+    lexer.Update(location.Line, line)
+    return lexer.Trigger()
+}
+
+/**
+ * Preprocessor directive of the line provided, if it was lexed last.
+ */
+func (ide *Ide) directive(path string, row int) string {
+    ide.lock.Lock()
+    defer ide.lock.Unlock()
+
+    if lexer, ok := ide.lexes[path]; ok && lexer.row == row {
+        return lexer.Directive()
     }
-    return 0
+    return ""
+}
+
+/**
+ * Whether the file completed or its unit declares a scope of the qualifier.
+ */
+func (ide *Ide) declares(
+    unit string, path string, content string, qualifier string) bool {
+
+    if DeclaresScope(content, qualifier) {
+        return true
+    }
+    if unit == path {
+        return false
+    }
+
+    source, ok := ide.service.buffers.Get(unit)
+    if !ok {
+        data, err := ioutil.ReadFile(unit)
+        if err != nil {
+            return false
+        }
+        source = string(data)
+    }
+    return DeclaresScope(source, qualifier)
 }
 
 func (ide *Ide) Complete(
-    content string, location *types.Location) *[]map[string]string {
+    content string, location *types.Location) *[]types.Completion {
 
-    var completions *[]map[string]string = nil
+    unit := ide.graph.Unit(location.Path)
+    if unit == "" {
+        return nil
+    }
 
-    if tu, ok := ide.units[location.Path]; ok {
-        completions = ide.clang.Complete(
-            tu, CompleteOptions, content,
-            location.Path, location.Line, location.Column)
+    // qualified scopes like std:: are shared by the files with the same
+    // flags and includes unless the file edited declares them, the contents
+    // are checked at each completion as they change while typing
+    qualifier := Qualifier(content, location.Line, location.Column)
+    var includes []string
+    var key uint64
+    if qualifier != "" &&
+        ide.declares(unit, location.Path, content, qualifier) {
+        qualifier = ""
+    }
+    if qualifier != "" {
+        includes = ide.graph.Includes(unit)
+        key = ScopeKey(ide.flags, qualifier, includes)
+        if completions := ide.service.scopes.Get(key); completions != nil {
+            return completions
+        }
+    }
+
+    options := completeOptions(
+        lineAt(content, location.Line), location.Column,
+        ide.directive(location.Path, location.Line))
+
+    pending.Add(1)
+    defer pending.Add(-1)
+    defer backendTime.Since(time.Now())
+
+    // a header is completed in the unit of its includer, with its contents
+    // passed as an unsaved file
+    // the other files modified, the file completed is passed as content
+    unsaved := ide.service.buffers.Unsaved(
+        append(ide.graph.Includes(unit), unit), location.Path)
+
+    completions, err := ide.backend.Complete(
+        unit, location.Path, options, content, unsaved,
+        location.Line, location.Column)
+
+    if err != nil {
+        types.LOG.Println(err)
+    } else if qualifier != "" && completions != nil &&
+        len(*completions) > 0 && !hasMembers(*completions) {
+        ide.service.scopes.Put(key, includes, completions)
     }
 
     return completions
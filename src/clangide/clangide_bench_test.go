@@ -0,0 +1,192 @@
+package clangide
+
+import (
+    "io/ioutil"
+    "log"
+    "os"
+    "path/filepath"
+    "runtime"
+    "runtime/debug"
+    "sort"
+    "strconv"
+    "strings"
+    "testing"
+    "time"
+    "github.com/vbogretsov/neoide/src/types"
+)
+
+const (
+    corpusPath   = "testdata/corpus.cpp"
+    corpusMarker = "/*^*/"
+    // resident growth per completion in bytes above which the soak fails,
+    // judged only on runs long enough to amortize the allocator noise
+    soakMaxGrowth = 64
+    soakMinOps    = 1000
+)
+
+/**
+ * The test binary also serves as the clang worker executable.
+ */
+func TestMain(m *testing.M) {
+    if len(os.Args) > 1 && os.Args[1] == WorkerCommand {
+        types.LOG = log.New(ioutil.Discard, "", 0)
+        ServeWorker(os.Stdin, os.Stdout)
+        return
+    }
+    os.Exit(m.Run())
+}
+
+/**
+ * Completion points of the corpus: the marker positions.
+ */
+func corpusLocations(path string, content string) []types.Location {
+    locations := []types.Location{}
+    for i, line := range strings.Split(content, "\n") {
+        if column := strings.Index(line, corpusMarker); column >= 0 {
+            locations = append(locations, types.Location{
+                Path: path, Line: i + 1, Column: column + 1})
+        }
+    }
+    return locations
+}
+
+func percentile(durations []time.Duration, p int) float64 {
+    return float64(durations[(len(durations) - 1) * p / 100].Nanoseconds())
+}
+
+/**
+ * Resident set size of the process in bytes.
+ */
+func residentSize(b *testing.B) int64 {
+    data, err := ioutil.ReadFile("/proc/self/statm")
+    if err != nil {
+        b.Skip("/proc/self/statm is not readable")
+    }
+    fields := strings.Fields(string(data))
+    pages, err := strconv.ParseInt(fields[1], 10, 64)
+    if err != nil {
+        b.Fatal(err)
+    }
+    return pages * int64(os.Getpagesize())
+}
+
+/**
+ * Corpus opened in an IDE using the libclang provided by the NEOIDE_LIBCLANG
+ * environment variable, NEOIDE_FLAGS overrides the flags.
+ */
+func openCorpus(
+    b *testing.B, workers int) (*Ide, string, []types.Location) {
+
+    sopath := os.Getenv("NEOIDE_LIBCLANG")
+    if sopath == "" {
+        b.Skip("NEOIDE_LIBCLANG is not set")
+    }
+
+    flags := strings.Fields(os.Getenv("NEOIDE_FLAGS"))
+    if len(flags) == 0 {
+        flags = []string{"-x", "c++", "-std=c++14"}
+    }
+
+    types.LOG = log.New(ioutil.Discard, "", 0)
+
+    path, err := filepath.Abs(corpusPath)
+    if err != nil {
+        b.Fatal(err)
+    }
+    data, err := ioutil.ReadFile(path)
+    if err != nil {
+        b.Fatal(err)
+    }
+    content := string(data)
+    locations := corpusLocations(path, content)
+
+    ide, err := New(sopath, flags, workers, false)
+    if err != nil {
+        b.Fatal(err)
+    }
+
+    ide.Enter(path, func(){})
+    return ide, content, locations
+}
+
+/**
+ * Completion latency of the backend. The scope cache is bypassed, so every
+ * completion reaches clang.
+ */
+func benchmarkComplete(b *testing.B, workers int) {
+    ide, content, locations := openCorpus(b, workers)
+    defer ide.Close()
+
+    durations := make([]time.Duration, b.N)
+    b.ReportAllocs()
+    b.ResetTimer()
+
+    for i := 0; i < b.N; i++ {
+        location := locations[i % len(locations)]
+        start := time.Now()
+        ide.backend.Complete(
+            location.Path, location.Path, CompleteOptions, content, nil,
+            location.Line, location.Column)
+        durations[i] = time.Since(start)
+    }
+
+    b.StopTimer()
+    sort.Slice(durations, func(i, j int) bool {
+        return durations[i] < durations[j]
+    })
+    b.ReportMetric(percentile(durations, 50), "p50-ns")
+    b.ReportMetric(percentile(durations, 99), "p99-ns")
+}
+
+func BenchmarkComplete(b *testing.B) {
+    benchmarkComplete(b, 0)
+}
+
+func BenchmarkCompleteWorkers(b *testing.B) {
+    benchmarkComplete(b, 2)
+}
+
+/**
+ * Resident memory growth over many completions, run with -benchtime 10000x
+ * or more. The completions bypass the scope cache, so every one of them
+ * passes the contents to libclang.
+ */
+func BenchmarkCompleteSoak(b *testing.B) {
+    ide, content, locations := openCorpus(b, 0)
+    defer ide.Close()
+
+    complete := func(location types.Location) {
+        _, err := ide.backend.Complete(
+            location.Path, location.Path, CompleteOptions, content, nil,
+            location.Line, location.Column)
+        if err != nil {
+            b.Fatal(err)
+        }
+    }
+
+    // libclang caches and the Go heap reach their steady size first
+    for _, location := range locations {
+        complete(location)
+    }
+    runtime.GC()
+    before := residentSize(b)
+
+    b.ResetTimer()
+    for i := 0; i < b.N; i++ {
+        complete(locations[i % len(locations)])
+    }
+    b.StopTimer()
+
+    runtime.GC()
+    debug.FreeOSMemory()
+    growth := residentSize(b) - before
+    perOp := float64(growth) / float64(b.N)
+    b.ReportMetric(float64(growth) / 1024, "rss-growth-KB")
+    b.ReportMetric(perOp, "rss-growth-B/op")
+
+    if b.N >= soakMinOps && perOp > soakMaxGrowth {
+        b.Errorf(
+            "resident size grew %.1f B per completion, at most %d expected",
+            perOp, soakMaxGrowth)
+    }
+}
@@ -0,0 +1,183 @@
+package clangide
+
+import (
+    "path/filepath"
+    "sort"
+    "strings"
+    "sync"
+    "github.com/vbogretsov/neoide/src/types"
+)
+
+/**
+ * Extensions of the files which are not parsed on their own when a unit
+ * including them is parsed.
+ */
+var headerExtensions = map[string]bool{
+    ".h": true, ".hh": true, ".hpp": true, ".hxx": true, ".h++": true,
+    ".inl": true, ".tcc": true}
+
+func isHeader(path string) bool {
+    return headerExtensions[strings.ToLower(filepath.Ext(path))]
+}
+
+/**
+ * Files included by the translation units parsed and the reverse mapping.
+ * Paths are made absolute by every method, as clang and vim may report the
+ * same file differently.
+ */
+type IncludeGraph struct {
+    lock      sync.Mutex
+    includes  map[string][]string
+    includers map[string]map[string]bool
+    listener  func(files []string)
+}
+
+func NewIncludeGraph() *IncludeGraph {
+    return &IncludeGraph{
+        includes: map[string][]string{},
+        includers: map[string]map[string]bool{}}
+}
+
+func (graph *IncludeGraph) remove(unit string) {
+    for _, header := range graph.includes[unit] {
+        if units, ok := graph.includers[header]; ok {
+            delete(units, unit)
+            if len(units) == 0 {
+                delete(graph.includers, header)
+            }
+        }
+    }
+    delete(graph.includes, unit)
+}
+
+/**
+ * Set the function called with the unit and the files it includes on every
+ * update.
+ */
+func (graph *IncludeGraph) Listen(listener func(files []string)) {
+    graph.lock.Lock()
+    defer graph.lock.Unlock()
+
+    graph.listener = listener
+}
+
+/**
+ * Replace the files included by the unit provided.
+ */
+func (graph *IncludeGraph) Update(unit string, includes []string) {
+    graph.lock.Lock()
+    listener := graph.listener
+    files := graph.update(unit, includes)
+    graph.lock.Unlock()
+
+    if listener != nil {
+        listener(files)
+    }
+}
+
+func (graph *IncludeGraph) update(unit string, includes []string) []string {
+    unit = types.AbsPath(unit)
+    graph.remove(unit)
+
+    // clang reports the paths as found in the include directories, which
+    // may be relative
+    cleaned := make([]string, len(includes))
+    for i, header := range includes {
+        cleaned[i] = types.AbsPath(header)
+    }
+
+    graph.includes[unit] = cleaned
+    for _, header := range cleaned {
+        units, ok := graph.includers[header]
+        if !ok {
+            units = map[string]bool{}
+            graph.includers[header] = units
+        }
+        units[unit] = true
+    }
+
+    return append(cleaned, unit)
+}
+
+func (graph *IncludeGraph) Remove(unit string) {
+    unit = types.AbsPath(unit)
+
+    graph.lock.Lock()
+    defer graph.lock.Unlock()
+
+    graph.remove(unit)
+}
+
+/**
+ * Whether the file provided has its own translation unit.
+ */
+func (graph *IncludeGraph) Has(unit string) bool {
+    unit = types.AbsPath(unit)
+
+    graph.lock.Lock()
+    defer graph.lock.Unlock()
+
+    _, ok := graph.includes[unit]
+    return ok
+}
+
+/**
+ * Files included by the unit provided, sorted.
+ */
+func (graph *IncludeGraph) Includes(unit string) []string {
+    unit = types.AbsPath(unit)
+
+    graph.lock.Lock()
+    defer graph.lock.Unlock()
+
+    includes := append([]string{}, graph.includes[unit]...)
+    sort.Strings(includes)
+    return includes
+}
+
+/**
+ * All the translation units.
+ */
+func (graph *IncludeGraph) Units() []string {
+    graph.lock.Lock()
+    defer graph.lock.Unlock()
+
+    units := make([]string, 0, len(graph.includes))
+    for unit := range graph.includes {
+        units = append(units, unit)
+    }
+    sort.Strings(units)
+    return units
+}
+
+/**
+ * Translation units including the file provided, sorted.
+ */
+func (graph *IncludeGraph) Includers(header string) []string {
+    header = types.AbsPath(header)
+
+    graph.lock.Lock()
+    defer graph.lock.Unlock()
+
+    units := make([]string, 0, len(graph.includers[header]))
+    for unit := range graph.includers[header] {
+        units = append(units, unit)
+    }
+    sort.Strings(units)
+    return units
+}
+
+/**
+ * Translation unit providing the file provided: its own unit or the one of
+ * an includer. Empty if there is none.
+ */
+func (graph *IncludeGraph) Unit(path string) string {
+    path = types.AbsPath(path)
+    if graph.Has(path) {
+        return path
+    }
+    if units := graph.Includers(path); len(units) > 0 {
+        return units[0]
+    }
+    return ""
+}
@@ -0,0 +1,392 @@
+/**
+ * Incremental C/C++ lexer used to decide whether completion can be triggered
+ * at the end of the line being edited.
+ *
+ * The lexer keeps the state of the current line of a buffer. When the line
+ * is only extended (usual typing) only the new characters are lexed, so a
+ * keystroke costs O(1). The state at a line start is taken from the end of
+ * the previous line when the cursor moves to the next line, otherwise from
+ * the states of the buffer lines scanned last. A new scan of the buffer only
+ * lexes the lines from the first one changed.
+ */
+package clangide
+
+import (
+    "strings"
+)
+
+/**
+ * Lexical context at the end of the line.
+ */
+const (
+    CtxCode      = iota
+    CtxDirective = iota
+    CtxInclude   = iota
+    CtxComment   = iota
+    CtxString    = iota
+)
+
+const (
+    stCode         = iota
+    stDirective    = iota
+    stDirectiveEnd = iota
+    stInclude      = iota
+    stLineComment  = iota
+    stBlockComment = iota
+    stString       = iota
+    stChar         = iota
+    stRawDelim     = iota
+    stRaw          = iota
+)
+
+/**
+ * State at a line start. The delimiter of a raw string and the name of a
+ * directive span the lines.
+ */
+type lexStart struct {
+    state int
+    delim string
+    name  string
+}
+
+type Lexer struct {
+    line   string
+    row    int
+    // line being lexed and the offset of the character fed
+    text   string
+    pos    int
+    // state at the line start
+    start  lexStart
+    state  int
+    // state to return to from a block comment
+    outer  int
+    escape bool
+    // directive name being read
+    name   []byte
+    // true if only spaces were seen since the line start
+    blank  bool
+    // last two code characters
+    p1, p2 byte
+    // identifier run length ending before p1 and p2, negative for numbers
+    r1, r2 int
+    // current identifier run length, negative for numbers
+    run    int
+    // raw string delimiter and the length of its closing matched, -1 if the
+    // closing is not being matched
+    delim  []byte
+    match  int
+    // lines of the buffer scanned and the states at their starts
+    lines  []string
+    starts []lexStart
+}
+
+func NewLexer() *Lexer {
+    return &Lexer{row: -1, blank: true}
+}
+
+func isRawPrefix(prefix string) bool {
+    switch prefix {
+    case "R", "LR", "uR", "UR", "u8R":
+        return true
+    }
+    return false
+}
+
+func isIdentStart(c byte) bool {
+    return c == '_' || (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z')
+}
+
+func isDigit(c byte) bool {
+    return c >= '0' && c <= '9'
+}
+
+func isIdent(c byte) bool {
+    return isIdentStart(c) || isDigit(c)
+}
+
+func isInclude(name []byte) bool {
+    switch string(name) {
+    case "include", "include_next", "import":
+        return true
+    }
+    return false
+}
+
+func (lx *Lexer) reset(start lexStart) {
+    lx.start = start
+    lx.state = start.state
+    lx.outer = stCode
+    lx.escape = false
+    lx.name = append(lx.name[:0], start.name...)
+    lx.delim = append(lx.delim[:0], start.delim...)
+    lx.match = -1
+    lx.blank = start.state == stCode
+    lx.p1, lx.p2 = 0, 0
+    lx.r1, lx.r2 = 0, 0
+    lx.run = 0
+}
+
+/**
+ * State in which the next line starts.
+ */
+func (lx *Lexer) next() lexStart {
+    continued := strings.HasSuffix(lx.line, "\\")
+    switch lx.state {
+    case stBlockComment:
+        return lexStart{state: stBlockComment}
+    case stRaw:
+        return lexStart{state: stRaw, delim: string(lx.delim)}
+    case stDirective, stDirectiveEnd:
+        if continued {
+            return lexStart{state: stDirectiveEnd, name: string(lx.name)}
+        }
+    case stLineComment:
+        if continued {
+            return lexStart{state: stLineComment}
+        }
+    }
+    return lexStart{state: stCode}
+}
+
+/**
+ * State at the start of the row provided, from the buffer scanned last.
+ */
+func (lx *Lexer) known(row int) lexStart {
+    if row >= 1 && row <= len(lx.starts) {
+        return lx.starts[row - 1]
+    }
+    return lexStart{state: stCode}
+}
+
+func (lx *Lexer) code(c byte) {
+    r0 := lx.run
+
+    switch {
+    case isIdentStart(c):
+        if lx.run >= 0 {
+            lx.run += 1
+        }
+    case isDigit(c):
+        if lx.run == 0 {
+            lx.run = -1
+        } else if lx.run > 0 {
+            lx.run += 1
+        }
+    case c == '\'' && lx.run < 0:
+        // digit separator
+    case c == '/' && lx.p1 == '/':
+        lx.state = stLineComment
+    case c == '*' && lx.p1 == '/':
+        lx.outer = lx.state
+        lx.state = stBlockComment
+        c = 0
+    case c == '"':
+        if lx.state == stDirectiveEnd && isInclude(lx.name) {
+            lx.state = stInclude
+        } else if lx.run > 0 && isRawPrefix(lx.text[lx.pos - lx.run:lx.pos]) {
+            lx.outer = lx.state
+            lx.state = stRawDelim
+            lx.delim = lx.delim[:0]
+        } else {
+            lx.outer = lx.state
+            lx.state = stString
+        }
+    case c == '\'':
+        lx.outer = lx.state
+        lx.state = stChar
+    case c == '<' && lx.state == stDirectiveEnd && isInclude(lx.name):
+        lx.state = stInclude
+    case c == '#' && lx.blank:
+        lx.state = stDirective
+        lx.name = lx.name[:0]
+    }
+
+    if !isIdent(c) && c != '\'' {
+        lx.run = 0
+    }
+    if c != ' ' && c != '\t' {
+        lx.blank = false
+    }
+
+    lx.p2, lx.p1 = lx.p1, c
+    lx.r2, lx.r1 = lx.r1, r0
+}
+
+func (lx *Lexer) feed(c byte) {
+    switch lx.state {
+    case stCode, stDirectiveEnd:
+        lx.code(c)
+    case stDirective:
+        if isIdent(c) {
+            lx.name = append(lx.name, c)
+        } else if c != ' ' && c != '\t' || len(lx.name) > 0 {
+            lx.state = stDirectiveEnd
+            lx.code(c)
+        }
+    case stLineComment, stInclude:
+        // till the end of line
+    case stBlockComment:
+        if c == '/' && lx.p1 == '*' {
+            lx.state = lx.outer
+            c = ' '
+            lx.run = 0
+        }
+        lx.p1 = c
+    case stRawDelim:
+        if c == '(' {
+            lx.state = stRaw
+            lx.match = -1
+        } else {
+            lx.delim = append(lx.delim, c)
+        }
+    case stRaw:
+        switch {
+        case lx.match == len(lx.delim) && c == '"':
+            lx.state = lx.outer
+            lx.p2, lx.p1 = 0, c
+            lx.r2, lx.r1 = 0, 0
+            lx.run = 0
+        case c == ')':
+            lx.match = 0
+        case lx.match >= 0 && lx.match < len(lx.delim) &&
+            c == lx.delim[lx.match]:
+            lx.match += 1
+        default:
+            lx.match = -1
+        }
+    case stString, stChar:
+        quote := byte('"')
+        if lx.state == stChar {
+            quote = '\''
+        }
+        if lx.escape {
+            lx.escape = false
+        } else if c == '\\' {
+            lx.escape = true
+        } else if c == quote {
+            lx.state = lx.outer
+            lx.p2, lx.p1 = 0, c
+            lx.r2, lx.r1 = 0, 0
+            lx.run = 0
+        }
+    }
+}
+
+/**
+ * Lex the line provided from the offset provided.
+ */
+func (lx *Lexer) lex(line string, from int) {
+    lx.text = line
+    for lx.pos = from; lx.pos < len(line); lx.pos++ {
+        lx.feed(line[lx.pos])
+    }
+    lx.line = line
+}
+
+/**
+ * Lex the line provided. The row is the line number in the buffer.
+ */
+func (lx *Lexer) Update(row int, line string) {
+    switch {
+    case row == lx.row && strings.HasPrefix(line, lx.line):
+        lx.lex(line, len(lx.line))
+    case row == lx.row:
+        lx.reset(lx.start)
+        lx.lex(line, 0)
+    case row == lx.row + 1:
+        lx.reset(lx.next())
+        lx.lex(line, 0)
+    default:
+        lx.reset(lx.known(row))
+        lx.lex(line, 0)
+    }
+    lx.row = row
+}
+
+/**
+ * Scan the contents of the buffer to know the state at each line start. Only
+ * the lines from the first one changed since the last scan are lexed. The
+ * line being edited is lexed again from its new start on the next update.
+ */
+func (lx *Lexer) Scan(content string) {
+    lines := strings.Split(content, "\n")
+
+    // the start of a line depends on the lines above it only
+    same := 0
+    for same < len(lines) && same < len(lx.lines) &&
+        lines[same] == lx.lines[same] {
+        same++
+    }
+
+    starts := lx.starts
+    if len(starts) > same + 1 {
+        starts = starts[:same + 1]
+    }
+    if len(starts) == 0 {
+        starts = append(starts, lexStart{state: stCode})
+    }
+
+    scanner := NewLexer()
+    for i := len(starts) - 1; i < len(lines) - 1; i++ {
+        scanner.reset(starts[i])
+        scanner.lex(lines[i], 0)
+        starts = append(starts, scanner.next())
+    }
+
+    lx.lines = lines
+    lx.starts = starts
+    lx.row = -1
+}
+
+/**
+ * Lexical context at the end of the line lexed.
+ */
+func (lx *Lexer) Context() int {
+    switch lx.state {
+    case stDirective:
+        return CtxDirective
+    case stDirectiveEnd:
+        if isInclude(lx.name) {
+            return CtxInclude
+        }
+        return CtxDirective
+    case stInclude:
+        return CtxInclude
+    case stLineComment, stBlockComment:
+        return CtxComment
+    case stString, stChar, stRawDelim, stRaw:
+        return CtxString
+    }
+    return CtxCode
+}
+
+/**
+ * Directive name if the line is a preprocessor directive.
+ */
+func (lx *Lexer) Directive() string {
+    if lx.state == stDirective || lx.state == stDirectiveEnd {
+        return string(lx.name)
+    }
+    return ""
+}
+
+/**
+ * Column where completion should be requested at the end of the line lexed,
+ * 0 if completion should not be triggered.
+ */
+func (lx *Lexer) Trigger() int {
+    if ctx := lx.Context(); ctx != CtxCode && ctx != CtxDirective {
+        return 0
+    }
+    switch {
+    case lx.p1 == '.' && lx.r1 > 0:
+        return len(lx.line) + 1
+    case lx.p1 == ':' && lx.p2 == ':' && lx.r2 > 0:
+        return len(lx.line) + 1
+    case lx.p1 == '>' && lx.p2 == '-' && lx.r2 > 0:
+        return len(lx.line) + 1
+    case lx.run == 1 && lx.p2 != 0 && lx.p2 != '.':
+        return len(lx.line)
+    }
+    return 0
+}
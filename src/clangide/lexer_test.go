@@ -0,0 +1,190 @@
+package clangide
+
+import (
+    "testing"
+)
+
+type lexed struct {
+    row  int
+    line string
+}
+
+func TestLexer(t *testing.T) {
+    cases := []struct {
+        name      string
+        lines     []lexed
+        context   int
+        directive string
+        trigger   int
+    }{
+        {"member", []lexed{{1, "foo."}}, CtxCode, "", 5},
+        {"pointer", []lexed{{1, "  foo->"}}, CtxCode, "", 8},
+        {"scope", []lexed{{1, "std::"}}, CtxCode, "", 6},
+        {"word", []lexed{{1, "x = y"}}, CtxCode, "", 5},
+        {"word after member", []lexed{{1, "foo.b"}}, CtxCode, "", 0},
+        {"number", []lexed{{1, "x = 1."}}, CtxCode, "", 0},
+        {"first word", []lexed{{1, "x"}}, CtxCode, "", 0},
+        {"after call", []lexed{{1, "foo()."}}, CtxCode, "", 0},
+
+        {"string", []lexed{{1, "s = \"foo."}}, CtxString, "", 0},
+        {"escaped quote", []lexed{{1, "s = \"a\\\"foo."}}, CtxString, "", 0},
+        {"after string", []lexed{{1, "s = \"a\" + foo."}}, CtxCode, "", 15},
+        {"raw string", []lexed{{1, "s = R\"(a\"b."}}, CtxString, "", 0},
+        {"after raw string", []lexed{{1, "s = u8R\"d(\")d\" + foo."}},
+            CtxCode, "", 22},
+        {"char", []lexed{{1, "c = 'a"}}, CtxString, "", 0},
+        {"after char", []lexed{{1, "c = '.'; foo."}}, CtxCode, "", 14},
+        {"line comment", []lexed{{1, "x; // foo."}}, CtxComment, "", 0},
+        {"block comment", []lexed{{1, "x; /* foo."}}, CtxComment, "", 0},
+        {"after block comment", []lexed{{1, "/* x */ foo."}}, CtxCode, "", 13},
+
+        {"include", []lexed{{1, "#include <vec"}}, CtxInclude, "", 0},
+        {"include quoted", []lexed{{1, "# include \"a."}}, CtxInclude, "", 0},
+        {"conditional", []lexed{{1, "#if A"}}, CtxDirective, "if", 5},
+        {"define", []lexed{{1, "#define X obj."}}, CtxDirective, "define", 15},
+
+        {"extended", []lexed{{1, "fo"}, {1, "foo."}}, CtxCode, "", 5},
+        {"edited", []lexed{{1, "/* a"}, {1, "foo."}}, CtxCode, "", 5},
+        {"block comment carried", []lexed{{1, "/* a"}, {2, "foo."}},
+            CtxComment, "", 0},
+        {"block comment closed", []lexed{{1, "/* a */"}, {2, "foo."}},
+            CtxCode, "", 5},
+        {"block comment closed next", []lexed{{1, "/* a"}, {2, "*/ foo."}},
+            CtxCode, "", 8},
+        {"string not carried", []lexed{{1, "s = \"a"}, {2, "foo."}},
+            CtxCode, "", 5},
+        {"line comment continued", []lexed{{1, "// a \\"}, {2, "foo."}},
+            CtxComment, "", 0},
+        {"directive continued", []lexed{{1, "#define X \\"}, {2, "  obj."}},
+            CtxDirective, "define", 7},
+        {"directive ended", []lexed{{1, "#define X"}, {2, "obj."}},
+            CtxCode, "", 5},
+        {"jump", []lexed{{1, "/* a"}, {3, "foo."}}, CtxCode, "", 5},
+        {"jump back", []lexed{{5, "/* a"}, {4, "foo."}}, CtxCode, "", 5},
+    }
+
+    for _, c := range cases {
+        lexer := NewLexer()
+        for _, l := range c.lines {
+            lexer.Update(l.row, l.line)
+        }
+
+        if context := lexer.Context(); context != c.context {
+            t.Errorf("%s: context %d, expected %d", c.name, context, c.context)
+        }
+        if directive := lexer.Directive(); directive != c.directive {
+            t.Errorf("%s: directive %q, expected %q",
+                c.name, directive, c.directive)
+        }
+        if trigger := lexer.Trigger(); trigger != c.trigger {
+            t.Errorf("%s: trigger %d, expected %d", c.name, trigger, c.trigger)
+        }
+    }
+}
+
+/**
+ * Typing a line character by character gives the state of lexing it at once.
+ */
+func TestLexerIncremental(t *testing.T) {
+    lines := []string{
+        "foo.bar->baz::", "s = \"a\\\"b\" + c.", "#include <a.h>",
+        "/* a */ b.", "x = 'c'; y.", "#define X(a) a.b",
+        "s = R\"x()\")x\" + a.",
+    }
+
+    for _, line := range lines {
+        whole := NewLexer()
+        whole.Update(1, line)
+
+        typed := NewLexer()
+        for i := 1; i <= len(line); i++ {
+            typed.Update(1, line[:i])
+        }
+
+        if typed.Context() != whole.Context() ||
+            typed.Directive() != whole.Directive() ||
+            typed.Trigger() != whole.Trigger() {
+            t.Errorf("%q: typed %d %q %d, whole %d %q %d", line,
+                typed.Context(), typed.Directive(), typed.Trigger(),
+                whole.Context(), whole.Directive(), whole.Trigger())
+        }
+    }
+}
+
+/**
+ * Lines lexed at a row of a buffer scanned first.
+ */
+func TestLexerScan(t *testing.T) {
+    buffer := "int a;\n" +
+        "/* comment\n" +
+        "   foo.\n" +
+        "*/\n" +
+        "s = R\"x(\n" +
+        "  obj. )\" )x\" + a;\n" +
+        "#define X \\\n" +
+        "  obj.\n" +
+        "foo."
+
+    cases := []struct {
+        name      string
+        row       int
+        line      string
+        context   int
+        directive string
+        trigger   int
+    }{
+        {"code", 1, "foo.", CtxCode, "", 5},
+        {"inside block comment", 3, "   foo.", CtxComment, "", 0},
+        {"after block comment", 5, "foo.", CtxCode, "", 5},
+        {"inside raw string", 6, "  obj.", CtxString, "", 0},
+        {"raw string closed", 6, "  obj. )\" )x\" + a.", CtxCode, "", 19},
+        {"raw string closed member", 6, "  )x\" + a.b + foo.",
+            CtxCode, "", 19},
+        {"directive continued", 8, "  obj.", CtxDirective, "define", 7},
+        {"last", 9, "foo.", CtxCode, "", 5},
+        {"out of buffer", 20, "foo.", CtxCode, "", 5},
+    }
+
+    for _, c := range cases {
+        lexer := NewLexer()
+        lexer.Scan(buffer)
+        lexer.Update(c.row, c.line)
+
+        if context := lexer.Context(); context != c.context {
+            t.Errorf("%s: context %d, expected %d", c.name, context, c.context)
+        }
+        if directive := lexer.Directive(); directive != c.directive {
+            t.Errorf("%s: directive %q, expected %q",
+                c.name, directive, c.directive)
+        }
+        if trigger := lexer.Trigger(); trigger != c.trigger {
+            t.Errorf("%s: trigger %d, expected %d", c.name, trigger, c.trigger)
+        }
+    }
+}
+
+/**
+ * A new scan lexes again the lines below the first one changed, and the
+ * line being edited is lexed again from its new start.
+ */
+func TestLexerRescan(t *testing.T) {
+    lexer := NewLexer()
+    lexer.Scan("int a;\nint b;\nfoo.")
+    lexer.Update(3, "foo.")
+    if lexer.Trigger() != 5 {
+        t.Errorf("trigger %d before the comment", lexer.Trigger())
+    }
+
+    lexer.Scan("int a; /*\nint b;\nfoo.")
+    lexer.Update(3, "foo.")
+    if lexer.Context() != CtxComment || lexer.Trigger() != 0 {
+        t.Errorf("context %d, trigger %d in the comment",
+            lexer.Context(), lexer.Trigger())
+    }
+
+    lexer.Scan("int a; /* */\nint b;\nfoo.")
+    lexer.Update(3, "foo.")
+    if lexer.Trigger() != 5 {
+        t.Errorf("trigger %d after the comment", lexer.Trigger())
+    }
+}
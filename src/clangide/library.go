@@ -0,0 +1,135 @@
+/**
+ * Libclang libraries loaded by path. A library is loaded once per process and
+ * shared by all the backends. Loading can be started in background when the
+ * daemon starts, so the first file opened does not wait for dlopen.
+ */
+package clangide
+
+import (
+    "sync"
+    "time"
+    "github.com/vbogretsov/neoide/src/libclang"
+    "github.com/vbogretsov/neoide/src/stats"
+    "github.com/vbogretsov/neoide/src/types"
+)
+
+var (
+    loadTime = stats.NewHistogram("clang.load")
+    waitTime = stats.NewHistogram("clang.load.wait")
+)
+
+type library struct {
+    done  chan struct{}
+    clang *libclang.Clang
+    index *libclang.Index
+    err   error
+}
+
+var (
+    librariesLock sync.Mutex
+    libraries     = map[string]*library{}
+)
+
+/**
+ * Get the library of the path provided, start loading it if needed.
+ */
+func loadLibrary(sopath string) *library {
+    librariesLock.Lock()
+    defer librariesLock.Unlock()
+
+    if lib, ok := libraries[sopath]; ok {
+        return lib
+    }
+
+    lib := &library{done: make(chan struct{})}
+    libraries[sopath] = lib
+
+    go func() {
+        defer close(lib.done)
+        defer loadTime.Since(time.Now())
+
+        lib.clang, lib.err = libclang.Load(sopath)
+        if lib.err == nil {
+            lib.index = lib.clang.CreateIndex(1, 1)
+        }
+    }()
+
+    return lib
+}
+
+/**
+ * Start loading the library provided and creating its index in background.
+ */
+func Preload(sopath string) {
+    types.LOG.Printf("preloading %s\n", sopath)
+    loadLibrary(sopath)
+}
+
+/**
+ * Close the index created in background for the library provided, if any.
+ * The pool workers load their own library, so the index would never be
+ * taken.
+ */
+func releaseIndex(sopath string) {
+    librariesLock.Lock()
+    lib, ok := libraries[sopath]
+    librariesLock.Unlock()
+    if !ok {
+        return
+    }
+
+    go func() {
+        <-lib.done
+        if lib.err != nil {
+            return
+        }
+
+        librariesLock.Lock()
+        index := lib.index
+        lib.index = nil
+        librariesLock.Unlock()
+
+        if index != nil {
+            lib.clang.CloseIndex(index)
+        }
+    }()
+}
+
+/**
+ * Wait for the library of the path provided. A library failed to load is
+ * forgotten, so the next call tries again.
+ */
+func openLibrary(sopath string) (*library, error) {
+    lib := loadLibrary(sopath)
+
+    start := time.Now()
+    <-lib.done
+    waitTime.Since(start)
+
+    if lib.err != nil {
+        librariesLock.Lock()
+        if libraries[sopath] == lib {
+            delete(libraries, sopath)
+        }
+        librariesLock.Unlock()
+        return nil, lib.err
+    }
+
+    return lib, nil
+}
+
+/**
+ * Take the index created in background, or create a new one if it was
+ * already taken.
+ */
+func (lib *library) takeIndex() *libclang.Index {
+    librariesLock.Lock()
+    index := lib.index
+    lib.index = nil
+    librariesLock.Unlock()
+
+    if index == nil {
+        index = lib.clang.CreateIndex(1, 1)
+    }
+    return index
+}
@@ -0,0 +1,622 @@
+/**
+ * Backend delegating translation units to a pool of worker processes. Each
+ * file is owned by one worker chosen by the path hash. A crashed worker is
+ * restarted and only the files it owned are parsed again. A file which
+ * crashed its worker MaxCrashes times within CrashWindow is not parsed
+ * again, and the restarts of a crashing worker are delayed increasingly.
+ *
+ * The contents of the files being completed and of the files modified are
+ * passed to the workers through shared memory buffers, so only the buffer
+ * names and the sequence numbers of the writes go through the pipe.
+ */
+package clangide
+
+import (
+    "errors"
+    "fmt"
+    "hash/fnv"
+    "net/rpc"
+    "os"
+    "os/exec"
+    "sync"
+    "time"
+    "github.com/vbogretsov/neoide/src/libclang"
+    "github.com/vbogretsov/neoide/src/shm"
+    "github.com/vbogretsov/neoide/src/stats"
+    "github.com/vbogretsov/neoide/src/trace"
+    "github.com/vbogretsov/neoide/src/types"
+)
+
+const (
+    MaxCrashes      = 3
+    CrashWindow     = time.Minute
+    RestartDelay    = 100 * time.Millisecond
+    RestartMaxDelay = 10 * time.Second
+)
+
+var (
+    workerRestarts = stats.NewCounter("workers.restarts")
+    workerCalls    = stats.NewGauge("workers.pending")
+    staleCalls     = stats.NewCounter("workers.stale")
+)
+
+type worker struct {
+    lock     sync.Mutex
+    id       int
+    load     *LoadArgs
+    cmd      *exec.Cmd
+    client   *rpc.Client
+    files    map[string]*ParseArgs
+    // calls in flight by file and recent crashes of the files
+    inflight map[string]int
+    crashes  map[string][]time.Time
+    started  time.Time
+    backoff  time.Duration
+    // closed when the restart in progress has started the new process
+    ready    chan struct{}
+    done     chan struct{}
+    closed   bool
+}
+
+/**
+ * Shared buffer of a file and the contents written last with their sequence
+ * number, a buffer is only written when the contents change.
+ */
+type sharedBuffer struct {
+    lock    sync.Mutex
+    buffer  *shm.Buffer
+    content string
+    seq     uint64
+}
+
+type Pool struct {
+    workers []*worker
+    major   int
+    minor   int
+    lock    sync.Mutex
+    buffers map[string]*sharedBuffer
+    created int
+    untrace func()
+}
+
+func NewPool(sopath string, size int, double bool) (*Pool, error) {
+    pool := &Pool{
+        workers: make([]*worker, size),
+        buffers: map[string]*sharedBuffer{}}
+    load := &LoadArgs{Path: sopath, Double: double}
+
+    for i := range pool.workers {
+        w := &worker{
+            id: i,
+            load: load,
+            files: map[string]*ParseArgs{},
+            inflight: map[string]int{},
+            crashes: map[string][]time.Time{},
+            done: make(chan struct{})}
+        trace.NameLane(w.lane(), fmt.Sprintf("clang worker %d", i))
+        version, err := w.start()
+        if err != nil {
+            pool.Close()
+            return nil, err
+        }
+        pool.workers[i] = w
+        pool.major, pool.minor = version.Major, version.Minor
+    }
+    pool.untrace = trace.AddSource(pool.trace)
+
+    return pool, nil
+}
+
+/**
+ * Start the worker process and load libclang in it. Called with the worker
+ * lock held or before the worker is shared.
+ */
+func (w *worker) start() (*VersionReply, error) {
+    exe, err := os.Executable()
+    if err != nil {
+        return nil, err
+    }
+
+    cmd := exec.Command(exe, WorkerCommand)
+    cmd.Stderr = os.Stderr
+
+    stdin, err := cmd.StdinPipe()
+    if err != nil {
+        return nil, err
+    }
+    stdout, err := cmd.StdoutPipe()
+    if err != nil {
+        return nil, err
+    }
+    if err := cmd.Start(); err != nil {
+        return nil, err
+    }
+
+    client := rpc.NewClient(pipe{stdout, stdin})
+    version := &VersionReply{}
+
+    if err := client.Call("Worker.Load", w.load, version); err != nil {
+        client.Close()
+        cmd.Process.Kill()
+        cmd.Wait()
+        return nil, err
+    }
+
+    w.cmd = cmd
+    w.client = client
+    w.started = time.Now()
+    go w.watch(cmd, client)
+
+    types.LOG.Printf("clang worker %d started, pid %d\n", w.id, cmd.Process.Pid)
+    return version, nil
+}
+
+func (w *worker) watch(cmd *exec.Cmd, client *rpc.Client) {
+    err := cmd.Wait()
+
+    w.lock.Lock()
+    closed := w.closed
+    w.lock.Unlock()
+
+    if !closed {
+        types.LOG.Printf("clang worker %d exited: %v\n", w.id, err)
+        w.restart(client)
+    }
+}
+
+/**
+ * Count a crash of the worker while handling the file provided. Called with
+ * the lock held.
+ */
+func (w *worker) crashed(path string, now time.Time) {
+    recent := []time.Time{now}
+    for _, crash := range w.crashes[path] {
+        if now.Sub(crash) < CrashWindow {
+            recent = append(recent, crash)
+        }
+    }
+    w.crashes[path] = recent
+}
+
+/**
+ * Whether the file provided crashed the worker too often to be handled
+ * again. Called with the lock held.
+ */
+func (w *worker) quarantined(path string) bool {
+    count := 0
+    for _, crash := range w.crashes[path] {
+        if time.Since(crash) < CrashWindow {
+            count += 1
+        }
+    }
+    return count >= MaxCrashes
+}
+
+/**
+ * Replace the worker process if it is still the one the client provided
+ * belongs to, and parse again the files the worker owned. The files being
+ * handled when the worker died are counted as crashed. The lock is only held
+ * to start the process, the calls made meanwhile wait for the restart in
+ * progress and the files are parsed again like any other call.
+ */
+func (w *worker) restart(client *rpc.Client) error {
+    w.lock.Lock()
+
+    if w.closed {
+        w.lock.Unlock()
+        return errors.New("clang worker is closed")
+    }
+    if ready := w.ready; ready != nil {
+        w.lock.Unlock()
+        select {
+        case <-ready:
+            return nil
+        case <-w.done:
+            return errors.New("clang worker is closed")
+        }
+    }
+    if w.client != client {
+        w.lock.Unlock()
+        return nil
+    }
+
+    ready := make(chan struct{})
+    w.ready = ready
+
+    now := time.Now()
+    for path := range w.inflight {
+        w.crashed(path, now)
+    }
+
+    w.client.Close()
+    w.cmd.Process.Kill()
+    workerRestarts.Add(1)
+    defer trace.Begin("restart", "worker", w.lane(), "").End()
+
+    // back off while the worker keeps dying shortly after its start
+    if now.Sub(w.started) >= CrashWindow {
+        w.backoff = 0
+    } else if w.backoff == 0 {
+        w.backoff = RestartDelay
+    } else if w.backoff *= 2; w.backoff > RestartMaxDelay {
+        w.backoff = RestartMaxDelay
+    }
+    backoff := w.backoff
+    w.lock.Unlock()
+
+    if backoff > 0 {
+        select {
+        case <-time.After(backoff):
+        case <-w.done:
+            w.lock.Lock()
+            w.ready = nil
+            close(ready)
+            w.lock.Unlock()
+            return errors.New("clang worker is closed")
+        }
+    }
+
+    // the calls waiting take the new client once the lock is released
+    w.lock.Lock()
+    w.ready = nil
+    close(ready)
+    if w.closed {
+        w.lock.Unlock()
+        return errors.New("clang worker is closed")
+    }
+    if _, err := w.start(); err != nil {
+        w.lock.Unlock()
+        types.LOG.Printf("unable to restart clang worker %d: %v\n", w.id, err)
+        return err
+    }
+
+    restored := make([]ParseArgs, 0, len(w.files))
+    for path, args := range w.files {
+        if w.quarantined(path) {
+            types.LOG.Printf(
+                "%s crashed clang %d times, not parsed again\n",
+                path, MaxCrashes)
+            delete(w.files, path)
+            continue
+        }
+        // the contents modified are stale, the next reparse passes them
+        restored = append(restored, *args)
+        restored[len(restored) - 1].Priority = PriorityBackground
+    }
+    w.lock.Unlock()
+
+    for i := range restored {
+        var includes []string
+        err := w.call("Parse", restored[i].Path, &restored[i], &includes)
+        if err == nil {
+            continue
+        }
+        types.LOG.Printf("unable to parse %s: %v\n", restored[i].Path, err)
+        if _, ok := err.(rpc.ServerError); !ok {
+            // the worker was restarted again and parsed the files itself
+            break
+        }
+    }
+
+    return nil
+}
+
+/**
+ * Call the worker for the file provided, empty if the call is not about a
+ * file. The worker is restarted and the call retried once if the worker
+ * crashed.
+ */
+func (w *worker) call(
+    method string, path string, args interface{}, reply interface{}) error {
+
+    workerCalls.Add(1)
+    defer workerCalls.Add(-1)
+    defer trace.Begin(method, "worker", w.lane(), path).End()
+
+    for attempt := 0; ; attempt++ {
+        w.lock.Lock()
+        if path != "" && w.quarantined(path) {
+            w.lock.Unlock()
+            return fmt.Errorf("%s crashed clang %d times", path, MaxCrashes)
+        }
+        client := w.client
+        if path != "" {
+            w.inflight[path] += 1
+        }
+        w.lock.Unlock()
+
+        err := client.Call("Worker." + method, args, reply)
+        _, served := err.(rpc.ServerError)
+        if !served && err != nil && attempt == 0 {
+            // the file is still in flight while the worker is restarted
+            if restartErr := w.restart(client); restartErr != nil {
+                err = restartErr
+                served = true
+            }
+        }
+
+        w.lock.Lock()
+        if path != "" {
+            if w.inflight[path] -= 1; w.inflight[path] == 0 {
+                delete(w.inflight, path)
+            }
+        }
+        w.lock.Unlock()
+
+        if served || err == nil || attempt > 0 {
+            return err
+        }
+    }
+}
+
+/**
+ * Trace lane of the worker.
+ */
+func (w *worker) lane() int {
+    return trace.LaneClang + 1 + w.id
+}
+
+func (w *worker) close() {
+    // wakes up a restart backing off
+    close(w.done)
+
+    w.lock.Lock()
+    defer w.lock.Unlock()
+
+    w.closed = true
+    if w.client != nil {
+        w.client.Close()
+    }
+}
+
+func (pool *Pool) shard(path string) *worker {
+    hash := fnv.New32a()
+    hash.Write([]byte(path))
+    return pool.workers[hash.Sum32() % uint32(len(pool.workers))]
+}
+
+/**
+ * Get the shared buffer of the file provided, creating it on first use.
+ */
+func (pool *Pool) buffer(path string) (*sharedBuffer, error) {
+    pool.lock.Lock()
+    defer pool.lock.Unlock()
+
+    if shared, ok := pool.buffers[path]; ok {
+        return shared, nil
+    }
+
+    pool.created += 1
+    buffer, err := shm.Create(shm.Name(pool.created))
+    if err != nil {
+        return nil, err
+    }
+
+    shared := &sharedBuffer{buffer: buffer}
+    pool.buffers[path] = shared
+    return shared, nil
+}
+
+/**
+ * Write the files provided to their shared buffers. A buffer is only locked
+ * while it is written, the worker rejects the call if the buffer is written
+ * again before it is done reading it. The files which could not be shared
+ * are returned as is.
+ */
+func (pool *Pool) share(files []libclang.UnsavedFile) (
+    shared []SharedFile, unsaved []libclang.UnsavedFile) {
+
+    for _, file := range files {
+        buffer, err := pool.buffer(file.Filename)
+        var seq uint64
+        var name string
+        if err == nil {
+            buffer.lock.Lock()
+            if buffer.seq == 0 || buffer.content != file.Contents {
+                buffer.seq, err = buffer.buffer.Write(file.Contents)
+                buffer.content = file.Contents
+                if err != nil {
+                    buffer.seq = 0
+                }
+            }
+            seq, name = buffer.seq, buffer.buffer.Name
+            buffer.lock.Unlock()
+        }
+
+        if err != nil {
+            types.LOG.Printf("shared buffer of %s: %v\n", file.Filename, err)
+            unsaved = append(unsaved, file)
+            continue
+        }
+        shared = append(shared, SharedFile{
+            Path: file.Filename, Buffer: name, Seq: seq})
+    }
+    return shared, unsaved
+}
+
+/**
+ * Share the files provided and call the worker with the arguments built
+ * from them. The call is made again once if the buffers were written by
+ * another call before the worker was done reading them.
+ */
+func (pool *Pool) callShared(
+    w *worker, method string, path string, files []libclang.UnsavedFile,
+    args func([]SharedFile, []libclang.UnsavedFile) interface{},
+    reply interface{}) error {
+
+    for attempt := 0; ; attempt++ {
+        shared, unsaved := pool.share(files)
+        err := w.call(method, path, args(shared, unsaved), reply)
+        if err != rpc.ServerError(StaleBuffers) || attempt > 0 {
+            return err
+        }
+        staleCalls.Add(1)
+    }
+}
+
+func (pool *Pool) removeBuffer(path string) {
+    pool.lock.Lock()
+    shared, ok := pool.buffers[path]
+    delete(pool.buffers, path)
+    pool.lock.Unlock()
+
+    if ok {
+        shared.lock.Lock()
+        shared.buffer.Remove()
+        shared.seq, shared.content = 0, ""
+        shared.lock.Unlock()
+    }
+}
+
+func (pool *Pool) Close() {
+    if pool.untrace != nil {
+        pool.untrace()
+    }
+    for _, w := range pool.workers {
+        if w != nil {
+            w.close()
+        }
+    }
+
+    pool.lock.Lock()
+    defer pool.lock.Unlock()
+
+    for _, shared := range pool.buffers {
+        shared.buffer.Remove()
+    }
+    pool.buffers = map[string]*sharedBuffer{}
+}
+
+/**
+ * Statistics of all the workers.
+ */
+func (pool *Pool) Stats() []stats.Snapshot {
+    result := []stats.Snapshot{}
+    for _, w := range pool.workers {
+        snapshots := []stats.Snapshot{}
+        if err := w.call("Stats", "", true, &snapshots); err == nil {
+            result = append(result, snapshots...)
+        }
+    }
+    return result
+}
+
+/**
+ * Spans recorded by the workers, a restarted worker loses the spans of the
+ * process it replaced.
+ */
+func (pool *Pool) trace() []trace.Process {
+    result := []trace.Process{}
+    for _, w := range pool.workers {
+        process := trace.Process{}
+        if err := w.call("Trace", "", true, &process); err == nil {
+            process.Name = fmt.Sprintf("clang worker %d", w.id)
+            result = append(result, process)
+        }
+    }
+    return result
+}
+
+/**
+ * Memory used by the translation units of all the workers.
+ */
+func (pool *Pool) Memory() []types.MemoryUsage {
+    result := []types.MemoryUsage{}
+    for _, w := range pool.workers {
+        usages := []types.MemoryUsage{}
+        if err := w.call("Memory", "", true, &usages); err == nil {
+            result = append(result, usages...)
+        }
+    }
+    return sortMemory(result)
+}
+
+func (pool *Pool) Version() (int, int) {
+    return pool.major, pool.minor
+}
+
+func (pool *Pool) Parse(
+    path string, flags []string, unsaved []libclang.UnsavedFile,
+    options int, priority int) ([]string, error) {
+
+    w := pool.shard(path)
+    args := &ParseArgs{
+        Path: path, Flags: flags, Options: options, Priority: priority}
+
+    // the files modified are not kept for the restarts
+    w.lock.Lock()
+    w.files[path] = args
+    w.lock.Unlock()
+
+    var includes []string
+    err := pool.callShared(w, "Parse", path, unsaved,
+        func(shared []SharedFile, rest []libclang.UnsavedFile) interface{} {
+            call := *args
+            call.Shared, call.Unsaved = shared, rest
+            return &call
+        }, &includes)
+    return includes, err
+}
+
+func (pool *Pool) Reparse(
+    path string, unsaved []libclang.UnsavedFile,
+    options int, priority int) ([]string, error) {
+
+    var includes []string
+    err := pool.callShared(pool.shard(path), "Reparse", path, unsaved,
+        func(shared []SharedFile, rest []libclang.UnsavedFile) interface{} {
+            return &ReparseArgs{
+                Path: path, Shared: shared, Unsaved: rest,
+                Options: options, Priority: priority}
+        }, &includes)
+    return includes, err
+}
+
+func (pool *Pool) Dispose(path string) {
+    w := pool.shard(path)
+
+    w.lock.Lock()
+    delete(w.files, path)
+    w.lock.Unlock()
+
+    var ok bool
+    w.call("Dispose", "", path, &ok)
+    pool.removeBuffer(path)
+}
+
+func (pool *Pool) Complete(
+    unit string, path string, options int, content string,
+    unsaved []libclang.UnsavedFile,
+    line int, column int) (*[]types.Completion, error) {
+
+    completions := []types.Completion{}
+
+    // the file completed is shared along with the other files modified
+    files := append(
+        []libclang.UnsavedFile{{Filename: path, Contents: content}},
+        unsaved...)
+
+    // the unit owner completes, the buffers are per file
+    err := pool.callShared(pool.shard(unit), "Complete", unit, files,
+        func(shared []SharedFile, rest []libclang.UnsavedFile) interface{} {
+            args := &CompleteArgs{
+                Unit: unit, Path: path, Options: options,
+                Line: line, Column: column}
+            for _, file := range shared {
+                if file.Path == path {
+                    args.Buffer, args.Seq = file.Buffer, file.Seq
+                } else {
+                    args.Shared = append(args.Shared, file)
+                }
+            }
+            for _, file := range rest {
+                if file.Filename == path {
+                    args.Content = file.Contents
+                } else {
+                    args.Unsaved = append(args.Unsaved, file)
+                }
+            }
+            return args
+        }, &completions)
+    return &completions, err
+}
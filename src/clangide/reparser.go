@@ -0,0 +1,229 @@
+package clangide
+
+import (
+    "sort"
+    "sync"
+    "time"
+    "github.com/vbogretsov/neoide/src/stats"
+    "github.com/vbogretsov/neoide/src/trace"
+    "github.com/vbogretsov/neoide/src/types"
+)
+
+/**
+ * Time the reparses are delayed for, so repeated saves make one batch.
+ */
+const BatchDelay = 300 * time.Millisecond
+
+var (
+    batchTime  = stats.NewHistogram("reparse.batch")
+    dependents = stats.NewCounter("reparse.dependents")
+)
+
+/**
+ * Background reparses of the units depending on the headers saved. Units of
+ * the visible files are reparsed first, the others at the indexing priority
+ * behind the rest of the background work.
+ */
+type Reparser struct {
+    lock     sync.Mutex
+    backend  Backend
+    graph    *IncludeGraph
+    buffers  *Buffers
+    options  int
+    pending  map[string]bool
+    visible  map[string]bool
+    reparsed map[string]time.Time
+    timer    *time.Timer
+    running  bool
+    closed   bool
+}
+
+func NewReparser(
+    backend Backend, graph *IncludeGraph, buffers *Buffers,
+    options int) *Reparser {
+
+    return &Reparser{
+        backend: backend,
+        graph: graph,
+        buffers: buffers,
+        options: options,
+        pending: map[string]bool{},
+        visible: map[string]bool{},
+        reparsed: map[string]time.Time{}}
+}
+
+/**
+ * Set the files visible in the editor.
+ */
+func (reparser *Reparser) Visible(paths []string) {
+    reparser.lock.Lock()
+    defer reparser.lock.Unlock()
+
+    reparser.visible = map[string]bool{}
+    for _, path := range paths {
+        reparser.visible[path] = true
+    }
+}
+
+/**
+ * Reparse the units provided in the next batch. Called with the lock held.
+ */
+func (reparser *Reparser) arm() {
+    if reparser.timer == nil && !reparser.running && !reparser.closed {
+        reparser.timer = time.AfterFunc(BatchDelay, reparser.run)
+    }
+}
+
+func (reparser *Reparser) Schedule(units []string) {
+    reparser.lock.Lock()
+    defer reparser.lock.Unlock()
+
+    for _, unit := range units {
+        reparser.pending[unit] = true
+    }
+    if len(reparser.pending) > 0 {
+        reparser.arm()
+    }
+}
+
+/**
+ * Record the start of a reparse of the unit provided.
+ */
+func (reparser *Reparser) Mark(unit string) {
+    reparser.lock.Lock()
+    defer reparser.lock.Unlock()
+
+    reparser.reparsed[unit] = time.Now()
+}
+
+/**
+ * Schedule the units affected by the changes made at the time provided,
+ * except the ones reparsed since.
+ */
+func (reparser *Reparser) ScheduleChanged(units []string, changed time.Time) {
+    reparser.lock.Lock()
+    stale := make([]string, 0, len(units))
+    for _, unit := range units {
+        if reparser.reparsed[unit].Before(changed) {
+            stale = append(stale, unit)
+        }
+    }
+    reparser.lock.Unlock()
+
+    reparser.Schedule(stale)
+}
+
+type job struct {
+    unit     string
+    priority int
+}
+
+/**
+ * Take the pending units, the visible ones first.
+ */
+func (reparser *Reparser) take() []job {
+    reparser.lock.Lock()
+    defer reparser.lock.Unlock()
+
+    reparser.timer = nil
+    if reparser.closed {
+        return nil
+    }
+
+    units := make([]string, 0, len(reparser.pending))
+    for unit := range reparser.pending {
+        units = append(units, unit)
+    }
+    reparser.pending = map[string]bool{}
+
+    visible := reparser.visible
+    sort.Slice(units, func(i, j int) bool {
+        if visible[units[i]] != visible[units[j]] {
+            return visible[units[i]]
+        }
+        return units[i] < units[j]
+    })
+
+    jobs := make([]job, len(units))
+    for i, unit := range units {
+        jobs[i] = job{unit, PriorityIndexing}
+        if visible[unit] {
+            jobs[i].priority = PriorityVisible
+        }
+    }
+
+    reparser.running = len(jobs) > 0
+    return jobs
+}
+
+/**
+ * Reparse the pending units. The units are scheduled one by one, so the
+ * completions are served between them.
+ */
+func (reparser *Reparser) run() {
+    jobs := reparser.take()
+    if len(jobs) == 0 {
+        return
+    }
+
+    start := time.Now()
+    span := trace.Begin("reparse_dependents", "clang", trace.LaneClang, "")
+
+    for _, job := range jobs {
+        unit := job.unit
+
+        reparser.lock.Lock()
+        closed := reparser.closed
+        reparser.lock.Unlock()
+
+        // closed or disposed in the meantime
+        if closed || !reparser.graph.Has(unit) {
+            reparser.Forget(unit)
+            continue
+        }
+
+        reparser.Mark(unit)
+        unsaved := reparser.buffers.Unsaved(
+            append(reparser.graph.Includes(unit), unit), "")
+        includes, err := reparser.backend.Reparse(
+            unit, unsaved, reparser.options, job.priority)
+        if err != nil {
+            types.LOG.Println(err)
+            continue
+        }
+        // nil if the unit was disposed meanwhile
+        if includes != nil {
+            reparser.graph.Update(unit, includes)
+        }
+        dependents.Add(1)
+    }
+
+    span.End()
+    batchTime.Since(start)
+
+    reparser.lock.Lock()
+    defer reparser.lock.Unlock()
+
+    reparser.running = false
+    if len(reparser.pending) > 0 {
+        reparser.arm()
+    }
+}
+
+func (reparser *Reparser) Forget(unit string) {
+    reparser.lock.Lock()
+    defer reparser.lock.Unlock()
+
+    delete(reparser.reparsed, unit)
+}
+
+func (reparser *Reparser) Close() {
+    reparser.lock.Lock()
+    defer reparser.lock.Unlock()
+
+    reparser.closed = true
+    if reparser.timer != nil {
+        reparser.timer.Stop()
+        reparser.timer = nil
+    }
+}
@@ -0,0 +1,104 @@
+package clangide
+
+import (
+    "sync"
+    "time"
+    "github.com/vbogretsov/neoide/src/stats"
+)
+
+/**
+ * Priority classes of the clang work, lower runs first: completions, the
+ * visible files, restoring the units of a restarted worker and reparsing
+ * the hidden units including a header changed.
+ */
+const (
+    PriorityInteractive = iota
+    PriorityVisible     = iota
+    PriorityBackground  = iota
+    PriorityIndexing    = iota
+    numPriorities       = iota
+)
+
+/**
+ * Time after which a waiting job is promoted by one class, so the
+ * background work is not starved by a stream of interactive requests.
+ */
+const AgingInterval = time.Second
+
+var waitTimes = [numPriorities]*stats.Histogram{
+    stats.NewHistogram("sched.wait.interactive"),
+    stats.NewHistogram("sched.wait.visible"),
+    stats.NewHistogram("sched.wait.background"),
+    stats.NewHistogram("sched.wait.indexing"),
+}
+
+type waiter struct {
+    priority int
+    since    time.Time
+    ready    chan struct{}
+}
+
+/**
+ * Lock of a clang executor granted by priority. Libclang calls cannot be
+ * interrupted, so the background jobs take the lock once per file and an
+ * interactive request waits at most for one file.
+ */
+type Scheduler struct {
+    lock    sync.Mutex
+    busy    bool
+    waiters []*waiter
+}
+
+func NewScheduler() *Scheduler {
+    return &Scheduler{}
+}
+
+func (scheduler *Scheduler) Acquire(priority int) {
+    start := time.Now()
+    defer waitTimes[priority].Since(start)
+
+    scheduler.lock.Lock()
+    if !scheduler.busy {
+        scheduler.busy = true
+        scheduler.lock.Unlock()
+        return
+    }
+
+    w := &waiter{priority: priority, since: start, ready: make(chan struct{})}
+    scheduler.waiters = append(scheduler.waiters, w)
+    scheduler.lock.Unlock()
+
+    <-w.ready
+}
+
+/**
+ * Priority of the waiter at the moment provided, promoted by the waiting
+ * time.
+ */
+func (w *waiter) effective(now time.Time) int {
+    return w.priority - int(now.Sub(w.since) / AgingInterval)
+}
+
+func (scheduler *Scheduler) Release() {
+    scheduler.lock.Lock()
+    defer scheduler.lock.Unlock()
+
+    if len(scheduler.waiters) == 0 {
+        scheduler.busy = false
+        return
+    }
+
+    // the waiters are in the arrival order, the first best one wins
+    now := time.Now()
+    best := 0
+    for i, w := range scheduler.waiters {
+        if w.effective(now) < scheduler.waiters[best].effective(now) {
+            best = i
+        }
+    }
+
+    w := scheduler.waiters[best]
+    scheduler.waiters = append(
+        scheduler.waiters[:best], scheduler.waiters[best + 1:]...)
+    close(w.ready)
+}
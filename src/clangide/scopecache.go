@@ -0,0 +1,196 @@
+package clangide
+
+import (
+    "hash/fnv"
+    "regexp"
+    "strings"
+    "sync"
+    "github.com/vbogretsov/neoide/src/stats"
+    "github.com/vbogretsov/neoide/src/types"
+)
+
+/**
+ * Number of the scopes cached.
+ */
+const ScopeCacheSize = 64
+
+var (
+    scopeHits   = stats.NewCounter("scopes.hits")
+    scopeMisses = stats.NewCounter("scopes.misses")
+)
+
+var qualifierPattern = regexp.MustCompile(`(?:^|[^\w:])((?:::)?(?:[A-Za-z_]\w*::)+)$`)
+
+/**
+ * Qualifier ending at the column provided, like std:: or ::ns::inner::.
+ * Empty if the completion is not in a qualified scope.
+ */
+func Qualifier(content string, line int, column int) string {
+    text := lineAt(content, line)
+    if column < 1 || column - 1 > len(text) {
+        return ""
+    }
+
+    match := qualifierPattern.FindStringSubmatch(text[:column - 1])
+    if match == nil {
+        return ""
+    }
+    return match[1]
+}
+
+/**
+ * Whether a scope of the qualifier provided is declared or reopened in the
+ * content provided. The completions of such a scope depend on the file, they
+ * are not shared.
+ */
+func DeclaresScope(content string, qualifier string) bool {
+    for _, name := range strings.Split(strings.Trim(qualifier, ":"), "::") {
+        pattern := regexp.MustCompile(
+            `\b(?:namespace|class|struct|union|enum)\s+` +
+            regexp.QuoteMeta(name) + `\b`)
+        if pattern.MatchString(content) {
+            return true
+        }
+    }
+    return false
+}
+
+/**
+ * Whether the completions have class members. The members of a class scope
+ * are filtered by the access from the completion context, so they are not
+ * shared.
+ */
+func hasMembers(completions []types.Completion) bool {
+    for i := range completions {
+        if completions[i].Kind == 'm' {
+            return true
+        }
+    }
+    return false
+}
+
+type scopeEntry struct {
+    completions *[]types.Completion
+    files       []string
+}
+
+/**
+ * Completions of qualified namespace scopes shared by the files. The results
+ * are keyed by the flags, the qualifier and the files included by the unit,
+ * and dropped when any of these files changes. Unqualified completions, class
+ * scopes and the scopes declared in the unit are not cached, they depend on
+ * the file being edited.
+ */
+type ScopeCache struct {
+    lock    sync.Mutex
+    entries map[uint64]*scopeEntry
+    order   []uint64
+    byFile  map[string]map[uint64]bool
+}
+
+func NewScopeCache() *ScopeCache {
+    return &ScopeCache{
+        entries: map[uint64]*scopeEntry{},
+        byFile: map[string]map[uint64]bool{}}
+}
+
+func ScopeKey(flags []string, qualifier string, includes []string) uint64 {
+    hash := fnv.New64a()
+    for _, flag := range flags {
+        hash.Write([]byte(flag))
+        hash.Write([]byte{0})
+    }
+    hash.Write([]byte{0})
+    hash.Write([]byte(qualifier))
+    hash.Write([]byte{0})
+    for _, file := range includes {
+        hash.Write([]byte(file))
+        hash.Write([]byte{0})
+    }
+    return hash.Sum64()
+}
+
+func (cache *ScopeCache) Get(key uint64) *[]types.Completion {
+    cache.lock.Lock()
+    defer cache.lock.Unlock()
+
+    if entry, ok := cache.entries[key]; ok {
+        scopeHits.Add(1)
+        return entry.completions
+    }
+    scopeMisses.Add(1)
+    return nil
+}
+
+/**
+ * Cache the completions of the key provided, computed from the files
+ * provided. The completions should not be modified afterwards.
+ */
+func (cache *ScopeCache) Put(
+    key uint64, files []string, completions *[]types.Completion) {
+
+    cache.lock.Lock()
+    defer cache.lock.Unlock()
+
+    if _, ok := cache.entries[key]; ok {
+        cache.remove(key)
+    }
+    if len(cache.order) >= ScopeCacheSize {
+        cache.remove(cache.order[0])
+    }
+
+    cache.entries[key] = &scopeEntry{completions: completions, files: files}
+    cache.order = append(cache.order, key)
+    for _, file := range files {
+        keys, ok := cache.byFile[file]
+        if !ok {
+            keys = map[uint64]bool{}
+            cache.byFile[file] = keys
+        }
+        keys[key] = true
+    }
+}
+
+func (cache *ScopeCache) remove(key uint64) {
+    entry, ok := cache.entries[key]
+    if !ok {
+        return
+    }
+    delete(cache.entries, key)
+
+    for i, k := range cache.order {
+        if k == key {
+            cache.order = append(cache.order[:i], cache.order[i + 1:]...)
+            break
+        }
+    }
+    for _, file := range entry.files {
+        if keys, ok := cache.byFile[file]; ok {
+            delete(keys, key)
+            if len(keys) == 0 {
+                delete(cache.byFile, file)
+            }
+        }
+    }
+}
+
+/**
+ * Drop the completions computed from the file provided.
+ */
+func (cache *ScopeCache) Invalidate(file string) {
+    cache.lock.Lock()
+    defer cache.lock.Unlock()
+
+    for key := range cache.byFile[file] {
+        cache.remove(key)
+    }
+}
+
+func (cache *ScopeCache) Clear() {
+    cache.lock.Lock()
+    defer cache.lock.Unlock()
+
+    cache.entries = map[uint64]*scopeEntry{}
+    cache.order = nil
+    cache.byFile = map[string]map[uint64]bool{}
+}
@@ -0,0 +1,95 @@
+// Corpus for the end-to-end completion benchmark. Completion is requested
+// at every /*^*/ marker.
+
+#include <algorithm>
+#include <map>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace corpus {
+
+struct Location
+{
+    std::string path;
+    int line;
+    int column;
+};
+
+class Document
+{
+public:
+    explicit Document(std::string path) : path_(std::move(path)) {}
+
+    void append(const std::string& line) { lines_.push_back(line); }
+
+    std::size_t size() const { return lines_.size(); }
+
+    const std::string& line(std::size_t i) const { return lines_.at(i); }
+
+    const std::string& path() const { return path_; }
+
+private:
+    std::string path_;
+    std::vector<std::string> lines_;
+};
+
+class Workspace
+{
+public:
+    Document& open(const std::string& path)
+    {
+        auto it = documents_.find(path);
+        if (it == documents_.end())
+        {
+            it = documents_.emplace(
+                path, std::make_unique<Document>(path)).first;
+        }
+        return *it->second;
+    }
+
+    std::vector<Location> find(const std::string& word) const
+    {
+        std::vector<Location> result;
+        for (const auto& entry : documents_)
+        {
+            const Document& document = *entry.second;
+            for (std::size_t i = 0; i < document.size(); ++i)
+            {
+                auto column = document.line(i).find(word);
+                if (column != std::string::npos)
+                {
+                    result.push_back(
+                        {document.path(), int(i + 1), int(column + 1)});
+                }
+            }
+        }
+        return result;
+    }
+
+private:
+    std::map<std::string, std::unique_ptr<Document>> documents_;
+};
+
+} // namespace corpus
+
+int main()
+{
+    corpus::Workspace workspace;
+    corpus::Document& document = workspace.open("main.cpp");
+    document./*^*/append("int main() {}");
+
+    auto locations = workspace.find("main");
+    std::sort(locations.begin(), locations.end(),
+              [](const corpus::Location& a, const corpus::Location& b) {
+                  return a./*^*/line < b.line;
+              });
+
+    std::string name = locations.front()./*^*/path;
+    name./*^*/size();
+
+    auto copy = std::/*^*/make_unique<corpus::Document>(name);
+    copy->/*^*/append(name);
+
+    return static_cast<int>(corpus::/*^*/Workspace().find("x").size());
+}
@@ -0,0 +1,202 @@
+/**
+ * File watcher over inotify. The directories of the units and of the files
+ * they include are watched, changes are reported in batches once no event
+ * came for WatchDelay, or after WatchMaxDelay during long event storms like
+ * branch switches.
+ */
+package clangide
+
+import (
+    "bytes"
+    "os"
+    "path/filepath"
+    "sync"
+    "syscall"
+    "time"
+    "unsafe"
+    "github.com/vbogretsov/neoide/src/stats"
+    "github.com/vbogretsov/neoide/src/types"
+)
+
+const (
+    WatchDelay    = 500 * time.Millisecond
+    WatchMaxDelay = 5 * time.Second
+)
+
+const watchEvents =
+    syscall.IN_CLOSE_WRITE |
+    syscall.IN_MOVED_TO |
+    syscall.IN_CREATE |
+    syscall.IN_DELETE
+
+var watchBatches = stats.NewCounter("watch.batches")
+
+type Watcher struct {
+    lock    sync.Mutex
+    file    *os.File
+    fd      int
+    dirs    map[string]bool
+    names   map[int]string
+    changed map[string]bool
+    all     bool
+    first   time.Time
+    last    time.Time
+    timer   *time.Timer
+    notify  func(paths []string, changed time.Time)
+}
+
+/**
+ * Create a watcher calling notify with the paths changed and the time of
+ * the latest change. The paths are nil if events were lost and everything
+ * should be considered changed.
+ */
+func NewWatcher(
+    notify func(paths []string, changed time.Time)) (*Watcher, error) {
+
+    fd, err := syscall.InotifyInit1(syscall.IN_CLOEXEC | syscall.IN_NONBLOCK)
+    if err != nil {
+        return nil, err
+    }
+
+    watcher := &Watcher{
+        // non-blocking, so the reads go through the poller and Close
+        // interrupts them
+        file: os.NewFile(uintptr(fd), "inotify"),
+        fd: fd,
+        dirs: map[string]bool{},
+        names: map[int]string{},
+        changed: map[string]bool{},
+        notify: notify}
+
+    go watcher.read()
+    return watcher, nil
+}
+
+/**
+ * Watch the directories of the files provided.
+ */
+func (watcher *Watcher) Add(files []string) {
+    watcher.lock.Lock()
+    defer watcher.lock.Unlock()
+
+    for _, file := range files {
+        dir := filepath.Dir(file)
+        if watcher.dirs[dir] {
+            continue
+        }
+        watcher.dirs[dir] = true
+
+        wd, err := syscall.InotifyAddWatch(watcher.fd, dir, watchEvents)
+        if err != nil {
+            types.LOG.Printf("unable to watch %s: %v\n", dir, err)
+            continue
+        }
+        watcher.names[wd] = dir
+    }
+}
+
+func (watcher *Watcher) read() {
+    buffer := make([]byte, 64 * 1024)
+
+    for {
+        n, err := watcher.file.Read(buffer)
+        if err != nil {
+            return
+        }
+
+        offset := 0
+        for offset + syscall.SizeofInotifyEvent <= n {
+            event := (*syscall.InotifyEvent)(unsafe.Pointer(&buffer[offset]))
+            start := offset + syscall.SizeofInotifyEvent
+            end := start + int(event.Len)
+            offset = end
+
+            if event.Mask & syscall.IN_Q_OVERFLOW != 0 {
+                watcher.changeAll()
+                continue
+            }
+
+            name := string(bytes.TrimRight(buffer[start:end], "\x00"))
+            watcher.change(int(event.Wd), name)
+        }
+    }
+}
+
+/**
+ * Schedule the flush of the batch. Called with the lock held.
+ */
+func (watcher *Watcher) arm() {
+    now := time.Now()
+    if watcher.timer == nil {
+        watcher.first = now
+    }
+    watcher.last = now
+
+    delay := WatchDelay
+    if limit := watcher.first.Add(WatchMaxDelay).Sub(now); limit < delay {
+        delay = limit
+    }
+
+    if watcher.timer == nil {
+        watcher.timer = time.AfterFunc(delay, watcher.flush)
+    } else {
+        watcher.timer.Reset(delay)
+    }
+}
+
+func (watcher *Watcher) change(wd int, name string) {
+    watcher.lock.Lock()
+    defer watcher.lock.Unlock()
+
+    dir, ok := watcher.names[wd]
+    if !ok || name == "" {
+        return
+    }
+    watcher.changed[filepath.Join(dir, name)] = true
+    watcher.arm()
+}
+
+func (watcher *Watcher) changeAll() {
+    watcher.lock.Lock()
+    defer watcher.lock.Unlock()
+
+    types.LOG.Println("inotify queue overflow")
+    watcher.all = true
+    watcher.arm()
+}
+
+func (watcher *Watcher) flush() {
+    watcher.lock.Lock()
+    var paths []string
+    if !watcher.all {
+        paths = make([]string, 0, len(watcher.changed))
+        for path := range watcher.changed {
+            paths = append(paths, path)
+        }
+    }
+    last := watcher.last
+    empty := !watcher.all && len(watcher.changed) == 0
+    watcher.changed = map[string]bool{}
+    watcher.all = false
+    watcher.timer = nil
+    watcher.lock.Unlock()
+
+    // a timer reset while firing
+    if empty {
+        return
+    }
+
+    watchBatches.Add(1)
+    watcher.notify(paths, last)
+}
+
+func (watcher *Watcher) Close() {
+    watcher.lock.Lock()
+    defer watcher.lock.Unlock()
+
+    if watcher.timer != nil {
+        watcher.timer.Stop()
+        watcher.timer = nil
+    }
+    watcher.file.Close()
+}
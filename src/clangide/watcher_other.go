@@ -0,0 +1,25 @@
+// +build !linux
+
+package clangide
+
+import (
+    "errors"
+    "time"
+)
+
+/**
+ * File watcher, implemented only on Linux.
+ */
+type Watcher struct{}
+
+func NewWatcher(
+    notify func(paths []string, changed time.Time)) (*Watcher, error) {
+
+    return nil, errors.New("file watching is not supported")
+}
+
+func (watcher *Watcher) Add(files []string) {
+}
+
+func (watcher *Watcher) Close() {
+}
@@ -0,0 +1,326 @@
+/**
+ * Worker process serving a local backend over net/rpc on its standard input
+ * and output. Workers are started and supervised by the pool backend.
+ */
+package clangide
+
+import (
+    "errors"
+    "io"
+    "net/rpc"
+    "sync"
+    "github.com/vbogretsov/neoide/src/libclang"
+    "github.com/vbogretsov/neoide/src/shm"
+    "github.com/vbogretsov/neoide/src/stats"
+    "github.com/vbogretsov/neoide/src/trace"
+    "github.com/vbogretsov/neoide/src/types"
+)
+
+/**
+ * Command line argument that makes neoided run as a clang worker.
+ */
+const WorkerCommand = "--clang-worker"
+
+/**
+ * Libclang to load, see NewLocal.
+ */
+type LoadArgs struct {
+    Path   string
+    Double bool
+}
+
+/**
+ * Parse request, the files modified are either Shared or Unsaved if they
+ * could not be shared.
+ */
+type ParseArgs struct {
+    Path     string
+    Flags    []string
+    Shared   []SharedFile
+    Unsaved  []libclang.UnsavedFile
+    Options  int
+    Priority int
+}
+
+/**
+ * Reply of a call whose shared buffers were written again before the worker
+ * was done reading them. The pool shares the files again and retries.
+ */
+const StaleBuffers = "shared buffers written meanwhile"
+
+/**
+ * File modified whose contents are in the shared buffer Buffer, written with
+ * the sequence number Seq.
+ */
+type SharedFile struct {
+    Path   string
+    Buffer string
+    Seq    uint64
+}
+
+/**
+ * Reparse request, the files modified are either Shared or Unsaved if they
+ * could not be shared.
+ */
+type ReparseArgs struct {
+    Path     string
+    Shared   []SharedFile
+    Unsaved  []libclang.UnsavedFile
+    Options  int
+    Priority int
+}
+
+/**
+ * Completion request in the file Path of the translation unit Unit. If
+ * Buffer is set, the contents are read from the shared buffer written with
+ * the sequence number Seq, otherwise Content is used. Shared and Unsaved
+ * are the other files modified.
+ */
+type CompleteArgs struct {
+    Unit    string
+    Path    string
+    Options int
+    Content string
+    Buffer  string
+    Seq     uint64
+    Shared  []SharedFile
+    Unsaved []libclang.UnsavedFile
+    Line    int
+    Column  int
+}
+
+type VersionReply struct {
+    Major int
+    Minor int
+}
+
+type Worker struct {
+    backend *Local
+    lock    sync.Mutex
+    buffers map[string]*shm.Buffer
+}
+
+/**
+ * Get the shared buffer of the file provided, opening it on first use.
+ */
+func (w *Worker) buffer(path string, name string) (*shm.Buffer, error) {
+    w.lock.Lock()
+    defer w.lock.Unlock()
+
+    if buffer, ok := w.buffers[path]; ok {
+        if buffer.Name == name {
+            return buffer, nil
+        }
+        buffer.Close()
+        delete(w.buffers, path)
+    }
+
+    buffer, err := shm.Open(name)
+    if err != nil {
+        return nil, err
+    }
+
+    w.buffers[path] = buffer
+    return buffer, nil
+}
+
+/**
+ * Contents of the shared file provided. The contents are mapped until the
+ * buffer is closed, they are valid until the buffer is written again.
+ */
+func (w *Worker) read(file SharedFile) ([]byte, error) {
+    buffer, err := w.buffer(file.Path, file.Buffer)
+    if err != nil {
+        return nil, err
+    }
+    content, err := buffer.Read(file.Seq)
+    if err != nil && buffer.Seq() != file.Seq {
+        return nil, errors.New(StaleBuffers)
+    }
+    return content, err
+}
+
+/**
+ * Error if a shared file was written again while it was being read, the
+ * contents read may be mixed.
+ */
+func (w *Worker) verify(shared []SharedFile) error {
+    for _, file := range shared {
+        if _, err := w.read(file); err != nil {
+            return err
+        }
+    }
+    return nil
+}
+
+/**
+ * Unsaved files mapping the shared files provided, followed by the unsaved
+ * files provided.
+ */
+func (w *Worker) unsaved(
+    shared []SharedFile,
+    unsaved []libclang.UnsavedFile) ([]libclang.UnsavedFile, error) {
+
+    if len(shared) == 0 {
+        return unsaved, nil
+    }
+
+    result := make([]libclang.UnsavedFile, 0, len(shared) + len(unsaved))
+    for _, file := range shared {
+        content, err := w.read(file)
+        if err != nil {
+            return nil, err
+        }
+        result = append(result, libclang.UnsavedFile{
+            Filename: file.Path, Mapped: content})
+    }
+    return append(result, unsaved...), nil
+}
+
+func (w *Worker) Load(args *LoadArgs, reply *VersionReply) error {
+    if w.backend != nil {
+        return errors.New("libclang is already loaded")
+    }
+
+    backend, err := NewLocal(args.Path, args.Double)
+    if err != nil {
+        return err
+    }
+
+    w.backend = backend
+    reply.Major, reply.Minor = backend.Version()
+    return nil
+}
+
+func (w *Worker) Parse(args *ParseArgs, reply *[]string) error {
+    if w.backend == nil {
+        return errors.New("libclang is not loaded")
+    }
+    unsaved, err := w.unsaved(args.Shared, args.Unsaved)
+    if err != nil {
+        return err
+    }
+    includes, err := w.backend.Parse(
+        args.Path, args.Flags, unsaved, args.Options, args.Priority)
+    if err == nil {
+        err = w.verify(args.Shared)
+    }
+    *reply = includes
+    return err
+}
+
+func (w *Worker) Reparse(args *ReparseArgs, reply *[]string) error {
+    if w.backend == nil {
+        return errors.New("libclang is not loaded")
+    }
+    unsaved, err := w.unsaved(args.Shared, args.Unsaved)
+    if err != nil {
+        return err
+    }
+    includes, err := w.backend.Reparse(
+        args.Path, unsaved, args.Options, args.Priority)
+    if err == nil {
+        err = w.verify(args.Shared)
+    }
+    *reply = includes
+    return err
+}
+
+func (w *Worker) Dispose(path string, reply *bool) error {
+    if w.backend == nil {
+        return errors.New("libclang is not loaded")
+    }
+    w.backend.Dispose(path)
+
+    w.lock.Lock()
+    if buffer, ok := w.buffers[path]; ok {
+        buffer.Close()
+        delete(w.buffers, path)
+    }
+    w.lock.Unlock()
+
+    return nil
+}
+
+func (w *Worker) Complete(
+    args *CompleteArgs, reply *[]types.Completion) error {
+
+    if w.backend == nil {
+        return errors.New("libclang is not loaded")
+    }
+
+    unsaved, err := w.unsaved(args.Shared, args.Unsaved)
+    if err != nil {
+        return err
+    }
+
+    var completions *[]types.Completion
+    shared := args.Shared
+
+    if args.Buffer != "" {
+        completed := SharedFile{args.Path, args.Buffer, args.Seq}
+        content, readErr := w.read(completed)
+        if readErr != nil {
+            return readErr
+        }
+        shared = append(shared, completed)
+        completions, err = w.backend.CompleteBuffer(
+            args.Unit, args.Path, args.Options, content, unsaved,
+            args.Line, args.Column)
+    } else {
+        completions, err = w.backend.Complete(
+            args.Unit, args.Path, args.Options, args.Content, unsaved,
+            args.Line, args.Column)
+    }
+    if err == nil {
+        err = w.verify(shared)
+    }
+
+    if completions != nil {
+        *reply = *completions
+    }
+    return err
+}
+
+func (w *Worker) Memory(args bool, reply *[]types.MemoryUsage) error {
+    if w.backend == nil {
+        return errors.New("libclang is not loaded")
+    }
+    *reply = w.backend.Memory()
+    return nil
+}
+
+func (w *Worker) Stats(args bool, reply *[]stats.Snapshot) error {
+    *reply = stats.Snapshots()
+    return nil
+}
+
+/**
+ * Spans recorded by the worker, empty unless the worker traces.
+ */
+func (w *Worker) Trace(args bool, reply *trace.Process) error {
+    *reply = trace.Snapshot()
+    return nil
+}
+
+type pipe struct {
+    io.Reader
+    io.WriteCloser
+}
+
+/**
+ * Serve worker requests until the input is closed.
+ */
+func ServeWorker(in io.Reader, out io.WriteCloser) {
+    worker := &Worker{buffers: map[string]*shm.Buffer{}}
+    server := rpc.NewServer()
+    server.RegisterName("Worker", worker)
+    server.ServeConn(pipe{in, out})
+
+    if worker.backend != nil {
+        worker.backend.Close()
+    }
+    for _, buffer := range worker.buffers {
+        buffer.Close()
+    }
+}
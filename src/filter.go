@@ -2,60 +2,91 @@ package main
 
 import (
     "sort"
-    "strconv"
+    "github.com/vbogretsov/neoide/src/types"
 )
 
-type byPrio []map[string]string
+const (
+    // Maximum value of the match score.
+    ScoreMax = 1000
+    // Candidates with lower match score are filtered out.
+    ScoreMin = 330
+    // Weight of a completer rank point in the match score scale.
+    RankWeight = 2
+    // Maximum number of candidates sent to vim.
+    MaxCompletions = 128
+)
+
+/**
+ * Candidate selected by the filter.
+ */
+type Match struct {
+    Index int
+    Score int
+}
 
-func (p byPrio) Len() int {
-    return len(p)
+type byScore struct {
+    items   []types.Completion
+    matches []Match
 }
 
-func (p byPrio) Swap(i, j int) {
-    p[i], p[j] = p[j], p[i]
+func (p byScore) Len() int {
+    return len(p.matches)
 }
 
-func (p byPrio) Less(i, j int) bool {
-    a, _ := strconv.ParseFloat(p[i]["prio"], 64)
-    b, _ := strconv.ParseFloat(p[j]["prio"], 64)
-    return a > b
+func (p byScore) Swap(i, j int) {
+    p.matches[i], p.matches[j] = p.matches[j], p.matches[i]
 }
 
-func Distance(word string, pattern string) float64 {
-    result := 0.0
-    lastMatch := 0.0
+func (p byScore) Less(i, j int) bool {
+    a, b := p.matches[i], p.matches[j]
+    if a.Score != b.Score {
+        return a.Score > b.Score
+    }
+    return p.items[a.Index].Word < p.items[b.Index].Word
+}
+
+/**
+ * Fuzzy match score of the word against the pattern in [0, ScoreMax].
+ */
+func Distance(word string, pattern string) int {
+    result := 0
+    lastMatch := 0
 
     if len(pattern) == 0 {
-        return 1.0
+        return ScoreMax
     }
 
     for pi := 0; pi < len(pattern); pi++ {
         for wi := 0; wi < len(word); wi++ {
-            match := 0.0
             if pattern[pi] == word[wi] {
-                match = 1.0 / (lastMatch + 1.0)
-            }
-            if match != 0 {
-                result += match;
-                lastMatch = 0;
-                break;
+                result += ScoreMax / (lastMatch + 1)
+                lastMatch = 0
+                break
             }
-            lastMatch += 1.0
+            lastMatch += 1
         }
     }
 
-    return result / float64(len(pattern))
+    return result / len(pattern)
 }
 
-func Filter(completions *[]map[string]string, word string) *[]map[string]string {
-    result := []map[string]string{}
-    for _, value := range *completions {
-        prio := Distance(value["word"], word)
-        if prio > 0.33 {
-            value["prio"] = strconv.FormatFloat(prio, 'E', -1, 64)
-            result = append(result, value)
+/**
+ * Select the candidates matching the word, best first. The score combines
+ * the fuzzy match score and the completer rank.
+ */
+func Filter(completions *[]types.Completion, word string) []Match {
+    items := *completions
+    matches := []Match{}
+    for i := range items {
+        score := Distance(items[i].Word, word)
+        if score > ScoreMin {
+            score -= items[i].Rank * RankWeight
+            matches = append(matches, Match{Index: i, Score: score})
         }
     }
-    sort.Sort(byPrio(result))
-    return &result
-}
\ No newline at end of file
+    sort.Sort(byScore{items, matches})
+    if len(matches) > MaxCompletions {
+        matches = matches[:MaxCompletions]
+    }
+    return matches
+}
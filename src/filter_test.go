@@ -0,0 +1,97 @@
+package main
+
+import (
+    "fmt"
+    "io/ioutil"
+    "math/rand"
+    "strings"
+    "testing"
+    "github.com/vbogretsov/neoide/src/types"
+    "github.com/neovim/go-client/msgpack"
+)
+
+var (
+    prefixes = []string{"get", "set", "is", "make", "to", "from", "on", ""}
+    stems    = []string{
+        "Value", "Size", "Buffer", "Completion", "Location", "Index",
+        "Translation", "Unit", "String", "Vector", "Map", "Iterator"}
+)
+
+func makeCompletions(n int) *[]types.Completion {
+    random := rand.New(rand.NewSource(1))
+    completions := make([]types.Completion, n)
+
+    for i := range completions {
+        word := prefixes[random.Intn(len(prefixes))] +
+            stems[random.Intn(len(stems))] +
+            stems[random.Intn(len(stems))]
+        completions[i] = types.Completion{
+            Abbr: fmt.Sprintf("int %s(int value)", word),
+            Word: word,
+            Menu: "[clang]",
+            Rank: random.Intn(80)}
+    }
+
+    return &completions
+}
+
+func BenchmarkDistance(b *testing.B) {
+    for i := 0; i < b.N; i++ {
+        Distance("getTranslationUnitIterator", "gtui")
+    }
+}
+
+func benchmarkFilter(b *testing.B, n int, word string) {
+    completions := makeCompletions(n)
+    b.ReportAllocs()
+    b.ResetTimer()
+    for i := 0; i < b.N; i++ {
+        Filter(completions, word)
+    }
+}
+
+func BenchmarkFilter1K(b *testing.B) {
+    benchmarkFilter(b, 1000, "gsv")
+}
+
+func BenchmarkFilter10K(b *testing.B) {
+    benchmarkFilter(b, 10000, "gsv")
+}
+
+func BenchmarkFilter10KEmpty(b *testing.B) {
+    benchmarkFilter(b, 10000, "")
+}
+
+func BenchmarkNewSession10K(b *testing.B) {
+    completions := makeCompletions(10000)
+    b.ReportAllocs()
+    b.ResetTimer()
+    for i := 0; i < b.N; i++ {
+        NewSession(completions)
+    }
+}
+
+func BenchmarkSessionReply(b *testing.B) {
+    session := NewSession(makeCompletions(10000))
+    reply := session.Filter("gsv")
+    encoder := msgpack.NewEncoder(ioutil.Discard)
+    b.ReportAllocs()
+    b.ResetTimer()
+    for i := 0; i < b.N; i++ {
+        reply.MarshalMsgPack(encoder)
+    }
+}
+
+func BenchmarkBufferWords(b *testing.B) {
+    completions := *makeCompletions(10000)
+    lines := make([]string, len(completions))
+    for i := range completions {
+        lines[i] = completions[i].Abbr + ";"
+    }
+    request := &Request{"a.cpp", strings.Join(lines, "\n"), 1, 1}
+    b.ReportAllocs()
+    b.ResetTimer()
+    for i := 0; i < b.N; i++ {
+        bufferWords{}.Complete(request)
+    }
+}
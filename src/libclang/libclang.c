@@ -18,6 +18,9 @@ char ERROR[1024];
         return NULL;                                                          \
     }
 
+#define IMPORT_OPTIONAL_FUNCTION(libclang, member, type, name)                \
+    libclang->member = (type)import_name(libclang->handle, name);
+
 // https://clang.llvm.org/doxygen/group__CINDEX.html#ga51eb9b38c18743bf2d824c6230e61f93
 typedef CXIndex (*clang_create_index_t)(int, int);
 
@@ -71,6 +74,22 @@ typedef enum CXCompletionChunkKind (*clang_get_completion_chunk_kind_t)(
 // https://clang.llvm.org/doxygen/group__CINDEX__CODE__COMPLET.html#gadb669685b9ef1f8ca62b2a044b846ac1
 typedef unsigned (*clang_default_code_complete_options_t)();
 
+// https://clang.llvm.org/doxygen/group__CINDEX__MISC.html
+typedef CXString (*clang_get_clang_version_t)();
+
+// https://clang.llvm.org/doxygen/group__CINDEX__MISC.html
+typedef void (*clang_get_inclusions_t)(
+    CXTranslationUnit, CXInclusionVisitor, CXClientData);
+
+// https://clang.llvm.org/doxygen/group__CINDEX__FILES.html
+typedef CXString (*clang_get_file_name_t)(CXFile);
+
+// https://clang.llvm.org/doxygen/group__CINDEX__TRANSLATION__UNIT.html
+typedef CXTUResourceUsage (*clang_get_tu_resource_usage_t)(CXTranslationUnit);
+
+// https://clang.llvm.org/doxygen/group__CINDEX__TRANSLATION__UNIT.html
+typedef void (*clang_dispose_tu_resource_usage_t)(CXTUResourceUsage);
+
 struct libclang
 {
     void* handle;
@@ -89,6 +108,13 @@ struct libclang
     clang_get_completion_chunk_text_t get_completion_chunk_text;
     clang_get_completion_chunk_kind_t get_completion_chunk_kind;
     clang_default_code_complete_options_t default_code_complete_options;
+    clang_get_clang_version_t get_clang_version;
+    clang_get_tu_resource_usage_t get_tu_resource_usage;
+    clang_dispose_tu_resource_usage_t dispose_tu_resource_usage;
+    clang_get_inclusions_t get_inclusions;
+    clang_get_file_name_t get_file_name;
+    unsigned version_major;
+    unsigned version_minor;
 };
 
 typedef void (*complete_chunk_t)(
@@ -110,6 +136,31 @@ const char* libclang_error()
     return errno < 0 ? ERROR : strerror(errno);
 }
 
+static void detect_version(libclang_t* so)
+{
+    static const char prefix[] = "clang version ";
+
+    so->version_major = 0;
+    so->version_minor = 0;
+
+    if (!so->get_clang_version)
+    {
+        return;
+    }
+
+    CXString version = so->get_clang_version();
+    const char* text = so->get_string(version);
+    const char* number = text ? strstr(text, prefix) : NULL;
+
+    if (number)
+    {
+        sscanf(number + sizeof(prefix) - 1, "%u.%u",
+               &so->version_major, &so->version_minor);
+    }
+
+    so->dispose_string(version);
+}
+
 libclang_t* libclang_load(const char* path)
 {
     void* handle = load_library(path);
@@ -120,7 +171,7 @@ libclang_t* libclang_load(const char* path)
         return NULL;
     }
 
-    libclang_t* so = (libclang_t*)malloc(sizeof(libclang_t));
+    libclang_t* so = (libclang_t*)calloc(1, sizeof(libclang_t));
     so->handle = handle;
 
     IMPORT_FUNCTION(so, create_index, clang_create_index_t,
@@ -154,6 +205,28 @@ libclang_t* libclang_load(const char* path)
                     clang_get_completion_chunk_kind_t,
                     "clang_getCompletionChunkKind");
 
+    IMPORT_OPTIONAL_FUNCTION(so, get_completion_brief_comment,
+                             clang_get_completion_brief_comment_t,
+                             "clang_getCompletionBriefComment");
+    IMPORT_OPTIONAL_FUNCTION(so, default_code_complete_options,
+                             clang_default_code_complete_options_t,
+                             "clang_defaultCodeCompleteOptions");
+    IMPORT_OPTIONAL_FUNCTION(so, get_clang_version,
+                             clang_get_clang_version_t,
+                             "clang_getClangVersion");
+    IMPORT_OPTIONAL_FUNCTION(so, get_tu_resource_usage,
+                             clang_get_tu_resource_usage_t,
+                             "clang_getCXTUResourceUsage");
+    IMPORT_OPTIONAL_FUNCTION(so, dispose_tu_resource_usage,
+                             clang_dispose_tu_resource_usage_t,
+                             "clang_disposeCXTUResourceUsage");
+    IMPORT_OPTIONAL_FUNCTION(so, get_inclusions, clang_get_inclusions_t,
+                             "clang_getInclusions");
+    IMPORT_OPTIONAL_FUNCTION(so, get_file_name, clang_get_file_name_t,
+                             "clang_getFileName");
+
+    detect_version(so);
+
     return so;
 }
 
@@ -163,6 +236,12 @@ void libclang_free(libclang_t* so)
     free(so);
 }
 
+void libclang_version(libclang_t* so, unsigned* major, unsigned* minor)
+{
+    *major = so->version_major;
+    *minor = so->version_minor;
+}
+
 index_t libclang_create_index(
     libclang_t* so, int excludeDeclarationsFromPCH, int displayDiagnostics)
 {
@@ -176,15 +255,18 @@ void libclang_dispose_index(libclang_t* so, index_t index)
 
 translation_unit_t libclang_parse_tu(
     libclang_t* so, index_t index, const char* path, const char* const* flags,
-    unsigned num_flags, unsigned options)
+    unsigned num_flags, unsaved_file_t* unsaved, unsigned num_unsaved,
+    unsigned options)
 {
-    return so->parse_tu(index, path, flags, num_flags, NULL, 0, options);
+    return so->parse_tu(
+        index, path, flags, num_flags, unsaved, num_unsaved, options);
 }
 
 int libclang_reparse_tu(
-    libclang_t* so, translation_unit_t tu, unsigned options)
+    libclang_t* so, translation_unit_t tu,
+    unsaved_file_t* unsaved, unsigned num_unsaved, unsigned options)
 {
-    return so->reparse_tu(tu, 0, NULL, options);
+    return so->reparse_tu(tu, num_unsaved, unsaved, options);
 }
 
 void libclang_dispose_tu(libclang_t* so, translation_unit_t tu)
@@ -192,6 +274,102 @@ void libclang_dispose_tu(libclang_t* so, translation_unit_t tu)
     so->dispose_tu(tu);
 }
 
+int libclang_tu_memory(
+    libclang_t* so, translation_unit_t tu, memory_usage_t* usage)
+{
+    memset(usage, 0, sizeof(memory_usage_t));
+
+    if (!so->get_tu_resource_usage || !so->dispose_tu_resource_usage)
+    {
+        return 0;
+    }
+
+    CXTUResourceUsage resources = so->get_tu_resource_usage(tu);
+
+    for (unsigned i = 0; i < resources.numEntries; ++i)
+    {
+        CXTUResourceUsageEntry* entry = &resources.entries[i];
+        switch (entry->kind)
+        {
+            case CXTUResourceUsage_AST:
+            case CXTUResourceUsage_AST_SideTables:
+            case CXTUResourceUsage_Identifiers:
+            case CXTUResourceUsage_Selectors:
+            case CXTUResourceUsage_GlobalCompletionResults:
+                usage->ast += entry->amount;
+                break;
+            // the precompiled preamble is the external AST source
+            case CXTUResourceUsage_ExternalASTSource_Membuffer_Malloc:
+            case CXTUResourceUsage_ExternalASTSource_Membuffer_MMap:
+                usage->preamble += entry->amount;
+                break;
+            case CXTUResourceUsage_SourceManagerContentCache:
+            case CXTUResourceUsage_SourceManager_Membuffer_Malloc:
+            case CXTUResourceUsage_SourceManager_Membuffer_MMap:
+            case CXTUResourceUsage_SourceManager_DataStructures:
+                usage->source_manager += entry->amount;
+                break;
+            default:
+                usage->other += entry->amount;
+                break;
+        }
+    }
+
+    so->dispose_tu_resource_usage(resources);
+    return 1;
+}
+
+typedef struct
+{
+    libclang_t* so;
+    char* data;
+    size_t size;
+    size_t capacity;
+} inclusions_t;
+
+static void visit_inclusion(
+    CXFile file, CXSourceLocation* stack, unsigned depth, CXClientData ctx)
+{
+    // the main file
+    if (depth == 0)
+    {
+        return;
+    }
+
+    inclusions_t* inclusions = (inclusions_t*)ctx;
+    CXString name = inclusions->so->get_file_name(file);
+    const char* path = inclusions->so->get_string(name);
+    size_t length = path ? strlen(path) : 0;
+
+    if (length > 0)
+    {
+        if (inclusions->size + length + 2 > inclusions->capacity)
+        {
+            inclusions->capacity = (inclusions->size + length + 2) * 2;
+            inclusions->data = realloc(inclusions->data, inclusions->capacity);
+        }
+        memcpy(inclusions->data + inclusions->size, path, length);
+        inclusions->size += length;
+        inclusions->data[inclusions->size++] = '\n';
+        inclusions->data[inclusions->size] = '\0';
+    }
+
+    inclusions->so->dispose_string(name);
+}
+
+char* libclang_inclusions(libclang_t* so, translation_unit_t tu)
+{
+    if (!so->get_inclusions || !so->get_file_name)
+    {
+        return NULL;
+    }
+
+    inclusions_t inclusions = {
+        .so = so, .data = calloc(1, 1), .size = 0, .capacity = 1};
+    so->get_inclusions(tu, &visit_inclusion, &inclusions);
+    return inclusions.data;
+}
+
 static void buffcpy(char buff[], unsigned* pos, unsigned size, const char* str)
 {
     unsigned i = 0;
@@ -334,6 +512,72 @@ static const char* kind_name(enum CXCursorKind kind)
     }
 }
 
+// Clang priorities of the local and member declarations, see CCP_* constants
+// in clang/Sema/CodeCompleteConsumer.h.
+#define PRIORITY_LOCAL 8
+#define PRIORITY_MEMBER 20
+
+static unsigned kind_rank(enum CXCursorKind kind)
+{
+    switch (kind)
+    {
+        case CXCursor_VarDecl:
+            return 0;
+        case CXCursor_ParmDecl:
+            return 0;
+        case CXCursor_FieldDecl:
+            return 0;
+        case CXCursor_CXXMethod:
+            return 4;
+        case CXCursor_FunctionDecl:
+            return 4;
+        case CXCursor_FunctionTemplate:
+            return 4;
+        case CXCursor_ConversionFunction:
+            return 4;
+        case CXCursor_EnumConstantDecl:
+            return 6;
+        case CXCursor_StructDecl:
+            return 8;
+        case CXCursor_UnionDecl:
+            return 8;
+        case CXCursor_ClassDecl:
+            return 8;
+        case CXCursor_ClassTemplate:
+            return 8;
+        case CXCursor_EnumDecl:
+            return 8;
+        case CXCursor_TypedefDecl:
+            return 8;
+        case CXCursor_Constructor:
+            return 12;
+        case CXCursor_Destructor:
+            return 16;
+        case CXCursor_MacroDefinition:
+            return 24;
+        default:
+            return 12;
+    }
+}
+
+static unsigned scope_rank(unsigned priority)
+{
+    if (priority <= PRIORITY_LOCAL)
+    {
+        return 0;
+    }
+    if (priority <= PRIORITY_MEMBER)
+    {
+        return 8;
+    }
+    return 20;
+}
+
+static unsigned completion_rank(enum CXCursorKind kind, unsigned priority)
+{
+    return priority + kind_rank(kind) + scope_rank(priority);
+}
+
 static complete_chunk_t completer(enum CXCompletionChunkKind kind)
 {
     switch (kind)
@@ -393,6 +637,9 @@ static void visit_completion(
     buffcpy(
         completion.abbr, &abbr_i, ABBR_SIZE, kind_name(result->CursorKind));
     CXCompletionString comp_string = result->CompletionString;
+    completion.priority = so->get_completion_priority(comp_string);
+    completion.rank = completion_rank(
+        result->CursorKind, completion.priority);
     unsigned num_chunks = so->get_num_completion_chunks(comp_string);
 
     for (unsigned j = 0; j < num_chunks; ++j)
@@ -412,14 +659,20 @@ static void visit_completion(
 completion_results_t* libclang_complete_at(
     libclang_t* so, translation_unit_t tu, unsigned options,
     const char* file_path, const char* file_content, unsigned file_size,
+    unsaved_file_t* unsaved, unsigned num_unsaved,
     unsigned line, unsigned column)
 {
-    struct CXUnsavedFile unsaved_file =
+    // the file completed first, then the other files modified
+    unsaved_file_t files[num_unsaved + 1];
+    files[0] = (unsaved_file_t)
         {.Filename = file_path, .Contents = file_content, .Length = file_size};
+    for (unsigned i = 0; i < num_unsaved; ++i)
+    {
+        files[i + 1] = unsaved[i];
+    }
 
     return so->complete_at(
-        tu, file_path, line, column,
-        (struct CXUnsavedFile[]){unsaved_file}, 1, options);
+        tu, file_path, line, column, files, num_unsaved + 1, options);
 }
 
 void libclang_completions_free(libclang_t* so, completion_results_t* results)
@@ -22,13 +22,31 @@ import "C"
 import (
     "errors"
     "fmt"
+    "runtime"
+    "strings"
+    "time"
     "unsafe"
+    "github.com/vbogretsov/neoide/src/stats"
+    "github.com/vbogretsov/neoide/src/types"
+)
+
+var (
+    parseTime    = stats.NewHistogram("clang.parse")
+    reparseTime  = stats.NewHistogram("clang.reparse")
+    completeTime = stats.NewHistogram("clang.complete")
+    convertTime  = stats.NewHistogram("clang.convert")
 )
 
 const (
+    TUIncomplete = C.CXTranslationUnit_Incomplete
     TUPrecompiledPreamble = C.CXTranslationUnit_PrecompiledPreamble
     TUCacheCompletionResults = C.CXTranslationUnit_CacheCompletionResults
-    TUIncomplete = C.CXTranslationUnit_Incomplete
+    TUSkipFunctionBodies = C.CXTranslationUnit_SkipFunctionBodies
+    TUCreatePreambleOnFirstParse =
+        C.CXTranslationUnit_CreatePreambleOnFirstParse
+    TUKeepGoing = C.CXTranslationUnit_KeepGoing
+    // Since clang 6, not declared in the bundled headers.
+    TULimitSkipFunctionBodiesToPreamble = 0x800
 )
 
 const (
@@ -47,11 +65,13 @@ func ReadCompletion(
     completion *C.completion_t, index C.uint, ctx unsafe.Pointer) {
 
     i := int(index)
-    completions := (*[1 << 30]map[string]string)(ctx)
-    completions[i] = map[string]string{
-        "abbr": C.GoString(&completion.abbr[0]),
-        "word": C.GoString(&completion.word[0]),
-        "menu": "[clang]"}
+    completions := (*[1 << 30]types.Completion)(ctx)
+    completions[i] = types.Completion{
+        Abbr: C.GoString(&completion.abbr[0]),
+        Word: C.GoString(&completion.word[0]),
+        Menu: "[clang]",
+        Kind: byte(completion.kind),
+        Rank: int(completion.rank)}
 }
 
 func ToCStrings(array []string) *CStrings {
@@ -69,6 +89,66 @@ func (strings *CStrings) Free() {
     C.free_string_array(strings.array, strings.size)
 }
 
+/**
+ * Contents of a file modified and not saved. Mapped holds the contents
+ * instead of Contents when they are mapped outside the Go heap, they are
+ * neither copied nor pinned then.
+ */
+type UnsavedFile struct {
+    Filename string
+    Contents string
+    Mapped   []byte
+}
+
+/**
+ * Unsaved files in C memory. The contents are not copied, they stay in the
+ * Go strings pinned until Free, as C memory refers to them.
+ */
+type unsavedFiles struct {
+    array  *C.unsaved_file_t
+    size   C.uint
+    pinner runtime.Pinner
+}
+
+func toUnsavedFiles(files []UnsavedFile) *unsavedFiles {
+    result := &unsavedFiles{size: C.uint(len(files))}
+    if len(files) == 0 {
+        return result
+    }
+
+    result.array = (*C.unsaved_file_t)(C.malloc(
+        C.size_t(len(files)) * C.sizeof_unsaved_file_t))
+    array := unsafe.Slice(result.array, len(files))
+
+    for i := range files {
+        array[i].Filename = C.CString(files[i].Filename)
+        array[i].Contents = nil
+        array[i].Length = C.ulong(len(files[i].Contents))
+        if mapped := files[i].Mapped; mapped != nil {
+            array[i].Length = C.ulong(len(mapped))
+            if len(mapped) > 0 {
+                array[i].Contents = (*C.char)(unsafe.Pointer(&mapped[0]))
+            }
+        } else if len(files[i].Contents) > 0 {
+            data := unsafe.StringData(files[i].Contents)
+            result.pinner.Pin(data)
+            array[i].Contents = (*C.char)(unsafe.Pointer(data))
+        }
+    }
+
+    return result
+}
+
+func (files *unsavedFiles) Free() {
+    if files.array != nil {
+        for _, file := range unsafe.Slice(files.array, int(files.size)) {
+            C.free(unsafe.Pointer(file.Filename))
+        }
+        C.free(unsafe.Pointer(files.array))
+    }
+    files.pinner.Unpin()
+}
+
 func ClangError() string {
     return C.GoString(C.libclang_error())
 }
@@ -86,7 +166,10 @@ type TranslationUnit struct {
 }
 
 func Load(sopath string) (*Clang, error) {
-    handle := C.libclang_load(C.CString(sopath))
+    path := C.CString(sopath)
+    defer C.free(unsafe.Pointer(path))
+
+    handle := C.libclang_load(path)
     if handle == nil {
         return nil, errors.New(fmt.Sprintf(
             "unable to load libclang: %s", C.GoString(C.libclang_error())))
@@ -98,6 +181,15 @@ func (clang *Clang) Close() {
     C.libclang_free(clang.handle)
 }
 
+/**
+ * Version of the libclang loaded, 0.0 if it cannot be detected.
+ */
+func (clang *Clang) Version() (int, int) {
+    var major, minor C.uint
+    C.libclang_version(clang.handle, &major, &minor)
+    return int(major), int(minor)
+}
+
 func (clang *Clang) CreateIndex(
     excludeDeclarationsFromPCH int, displayDiagnostics int) *Index {
 
@@ -113,40 +205,149 @@ func (clang *Clang) CloseIndex(index *Index) {
 
 // TODO: add errors handling
 func (clang *Clang) ParseTu(
-    index *Index, filename string,
-    flags *CStrings, options int) *TranslationUnit {
+    index *Index, filename string, flags *CStrings,
+    unsaved []UnsavedFile, options int) *TranslationUnit {
+
+    defer parseTime.Since(time.Now())
+
+    name := C.CString(filename)
+    defer C.free(unsafe.Pointer(name))
+
+    files := toUnsavedFiles(unsaved)
+    defer files.Free()
 
     handle := C.libclang_parse_tu(
-        clang.handle, index.handle, C.CString(filename),
-        flags.array, flags.size, C.uint(options))
+        clang.handle, index.handle, name,
+        flags.array, flags.size, files.array, files.size, C.uint(options))
+    if handle == nil {
+        return nil
+    }
     return &TranslationUnit{handle: handle}
 }
 
-func (clang *Clang) ReparseTu(tu *TranslationUnit, options int) {
-    C.libclang_reparse_tu(clang.handle, tu.handle, C.uint(options))
+func (clang *Clang) ReparseTu(
+    tu *TranslationUnit, unsaved []UnsavedFile, options int) {
+
+    defer reparseTime.Since(time.Now())
+
+    files := toUnsavedFiles(unsaved)
+    defer files.Free()
+
+    C.libclang_reparse_tu(
+        clang.handle, tu.handle, files.array, files.size, C.uint(options))
 }
 
 func (clang *Clang) CloseTu(tu *TranslationUnit) {
     C.libclang_dispose_tu(clang.handle, tu.handle)
 }
 
-// TODO: add error handling
-func (clang *Clang) Complete(
-    tu *TranslationUnit, options int, content string, filename string,
-    line int, column int) *[]map[string]string {
+/**
+ * Memory used by the translation unit, false if the libclang loaded does not
+ * report it.
+ */
+func (clang *Clang) TuMemory(tu *TranslationUnit) (types.MemoryUsage, bool) {
+    var usage C.memory_usage_t
+    ok := C.libclang_tu_memory(clang.handle, tu.handle, &usage) != 0
+    return types.MemoryUsage{
+        AST: uint64(usage.ast),
+        Preamble: uint64(usage.preamble),
+        SourceManager: uint64(usage.source_manager),
+        Other: uint64(usage.other)}, ok
+}
 
-    results := C.libclang_complete_at(
-        clang.handle, tu.handle, C.uint(options), C.CString(filename),
-        C.CString(content), C.uint(len(content)), C.uint(line), C.uint(column))
-    defer C.libclang_completions_free(clang.handle, results)
+/**
+ * Files included by the translation unit, directly or not. False if the
+ * libclang loaded does not report inclusions.
+ */
+func (clang *Clang) Inclusions(tu *TranslationUnit) ([]string, bool) {
+    data := C.libclang_inclusions(clang.handle, tu.handle)
+    if data == nil {
+        return nil, false
+    }
+    defer C.free(unsafe.Pointer(data))
+
+    text := C.GoString(data)
+    if text == "" {
+        return []string{}, true
+    }
+    return strings.Split(strings.TrimSuffix(text, "\n"), "\n"), true
+}
+
+func readCompletions(
+    clang *Clang, results *C.completion_results_t) *[]types.Completion {
 
     if results == nil || results.NumResults == 0 {
-        return &[]map[string]string{}
+        return &[]types.Completion{}
     }
 
-    completions := make([]map[string]string, results.NumResults)
+    defer convertTime.Since(time.Now())
+    completions := make([]types.Completion, results.NumResults)
     ctx := unsafe.Pointer(&completions[0])
     C.copy_completions(clang.handle, results, ctx)
 
     return &completions
+}
+
+/**
+ * Get completions using the contents provided without copying them. The
+ * contents should not be in the Go heap or should not be moved during the
+ * call. The unsaved files are the other files modified.
+ */
+func (clang *Clang) CompleteBuffer(
+    tu *TranslationUnit, options int, content []byte, filename string,
+    unsaved []UnsavedFile, line int, column int) *[]types.Completion {
+
+    var data *C.char
+    if len(content) > 0 {
+        data = (*C.char)(unsafe.Pointer(&content[0]))
+    }
+
+    name := C.CString(filename)
+    defer C.free(unsafe.Pointer(name))
+
+    files := toUnsavedFiles(unsaved)
+    defer files.Free()
+
+    start := time.Now()
+    results := C.libclang_complete_at(
+        clang.handle, tu.handle, C.uint(options), name,
+        data, C.uint(len(content)), files.array, files.size,
+        C.uint(line), C.uint(column))
+    completeTime.Since(start)
+    defer C.libclang_completions_free(clang.handle, results)
+
+    return readCompletions(clang, results)
+}
+
+/**
+ * Get completions using the contents provided without copying them. The
+ * contents are passed to libclang as a pointer into the Go string, which is
+ * valid for the call and copied by libclang. The unsaved files are the other
+ * files modified.
+ */
+// TODO: add error handling
+func (clang *Clang) Complete(
+    tu *TranslationUnit, options int, content string, filename string,
+    unsaved []UnsavedFile, line int, column int) *[]types.Completion {
+
+    var data *C.char
+    if len(content) > 0 {
+        data = (*C.char)(unsafe.Pointer(unsafe.StringData(content)))
+    }
+
+    name := C.CString(filename)
+    defer C.free(unsafe.Pointer(name))
+
+    files := toUnsavedFiles(unsaved)
+    defer files.Free()
+
+    start := time.Now()
+    results := C.libclang_complete_at(
+        clang.handle, tu.handle, C.uint(options), name,
+        data, C.uint(len(content)), files.array, files.size,
+        C.uint(line), C.uint(column))
+    completeTime.Since(start)
+    defer C.libclang_completions_free(clang.handle, results)
+
+    return readCompletions(clang, results)
 }
\ No newline at end of file
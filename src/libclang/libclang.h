@@ -12,18 +12,35 @@ typedef struct libclang libclang_t;
 typedef CXIndex index_t;
 typedef CXTranslationUnit translation_unit_t;
 typedef CXCodeCompleteResults completion_results_t;
+typedef struct CXUnsavedFile unsaved_file_t;
 
 #define ABBR_SIZE 128
 #define WORD_SIZE 128
 
+/**
+ * Completion candidate. The priority is the one reported by clang, the rank
+ * combines it with the cursor kind and the scope locality (lower is better).
+ */
 typedef struct
 {
     char abbr[ABBR_SIZE];
     char word[WORD_SIZE];
     char kind;
     unsigned priority;
+    unsigned rank;
 } completion_t;
 
+/**
+ * Memory used by a translation unit in bytes, by category.
+ */
+typedef struct
+{
+    unsigned long ast;
+    unsigned long preamble;
+    unsigned long source_manager;
+    unsigned long other;
+} memory_usage_t;
+
 /**
  * Create uninitialized char array.
  * @param  size Array size.
@@ -58,6 +75,14 @@ libclang_t* libclang_load(const char* path);
  */
 void libclang_free(libclang_t* so);
 
+/**
+ * Get version of the libclang loaded, 0.0 if it cannot be detected.
+ * @param so    Library handle.
+ * @param major Major version.
+ * @param minor Minor version.
+ */
+void libclang_version(libclang_t* so, unsigned* major, unsigned* minor);
+
 /**
  * Create clang index.
  * @param  so                         Library handle.
@@ -77,27 +102,33 @@ void libclang_dispose_index(libclang_t* so, index_t index);
 
 /**
  * Parse translation unit.
- * @param  so        Library handle.
- * @param  index     Clang index.
- * @param  path      Source file path.
- * @param  flags     Compiler flags.
- * @param  num_flags Number of compiler flags.
- * @param  options   Translation options.
- * @return           Translation unit parsed.
+ * @param  so          Library handle.
+ * @param  index       Clang index.
+ * @param  path        Source file path.
+ * @param  flags       Compiler flags.
+ * @param  num_flags   Number of compiler flags.
+ * @param  unsaved     Files modified and not saved.
+ * @param  num_unsaved Number of files modified and not saved.
+ * @param  options     Translation options.
+ * @return             Translation unit parsed.
  */
 translation_unit_t libclang_parse_tu(
     libclang_t* so, index_t index, const char* path,
-    const char* const* flags, unsigned num_flags, unsigned options);
+    const char* const* flags, unsigned num_flags,
+    unsaved_file_t* unsaved, unsigned num_unsaved, unsigned options);
 
 /**
  * Reparse translation unit.
- * @param  so      Library handle.
- * @param  tu      Translation unit to reparse.
- * @param  options Parse options.
- * @return         0 if success.
+ * @param  so          Library handle.
+ * @param  tu          Translation unit to reparse.
+ * @param  unsaved     Files modified and not saved.
+ * @param  num_unsaved Number of files modified and not saved.
+ * @param  options     Parse options.
+ * @return             0 if success.
  */
 int libclang_reparse_tu(
-    libclang_t* so, translation_unit_t tu, unsigned options);
+    libclang_t* so, translation_unit_t tu,
+    unsaved_file_t* unsaved, unsigned num_unsaved, unsigned options);
 
 /**
  * Dispose translation unit.
@@ -106,6 +137,25 @@ int libclang_reparse_tu(
  */
 void libclang_dispose_tu(libclang_t* so, translation_unit_t tu);
 
+/**
+ * Get memory used by the translation unit provided.
+ * @param  so    Library handle.
+ * @param  tu    Translation unit.
+ * @param  usage Memory usage by category.
+ * @return       0 if the libclang loaded does not report memory usage.
+ */
+int libclang_tu_memory(
+    libclang_t* so, translation_unit_t tu, memory_usage_t* usage);
+
+/**
+ * Get files included by the translation unit provided, directly or not.
+ * @param  so Library handle.
+ * @param  tu Translation unit.
+ * @return    Paths separated by new lines, should be freed by the caller.
+ *            NULL if the libclang loaded does not report inclusions.
+ */
+char* libclang_inclusions(libclang_t* so, translation_unit_t tu);
+
 /**
  * Get autocompletions in the file provided.
  * @param  so           Library handle.
@@ -114,6 +164,8 @@ void libclang_dispose_tu(libclang_t* so, translation_unit_t tu);
  * @param  file_path    Path of file for which to search completions.
  * @param  file_content Content of file for which to search completions.
  * @param  file_size    Size of file for which to search completions.
+ * @param  unsaved      Other files modified and not saved.
+ * @param  num_unsaved  Number of other files modified and not saved.
  * @param  line         Line number where to search completions.
  * @param  column       Column number where to search completions.
  * @return              Completions results.
@@ -121,6 +173,7 @@ void libclang_dispose_tu(libclang_t* so, translation_unit_t tu);
 completion_results_t* libclang_complete_at(
     libclang_t* so, translation_unit_t tu, unsigned options,
     const char* file_path, const char* file_content, unsigned file_size,
+    unsaved_file_t* unsaved, unsigned num_unsaved,
     unsigned line, unsigned column);
 
 /**
@@ -3,6 +3,7 @@ package main
 import (
     "log"
     "os"
+    "github.com/vbogretsov/neoide/src/trace"
     "github.com/vbogretsov/neoide/src/types"
     "github.com/neovim/go-client/nvim/plugin"
     "github.com/neovim/go-client/nvim"
@@ -19,8 +20,31 @@ func openLogFile(path string) *os.File {
     return file
 }
 
-func loadPlugins() map[string]func(*nvim.Nvim)(types.Plugin, error) {
-    plugins := map[string]func(*nvim.Nvim)(types.Plugin, error) {
+/**
+ * Vim client over the nvim RPC connection.
+ */
+type nvimClient struct {
+    *nvim.Nvim
+}
+
+func (client nvimClient) Batch(calls ...*types.VimCall) error {
+    batch := client.NewBatch()
+    for _, call := range calls {
+        batch.Call(call.Name, call.Result, call.Args...)
+    }
+    return batch.Execute()
+}
+
+func handleFunction(p *plugin.Plugin, name string, handler Handler) {
+    p.HandleFunction(
+        &plugin.FunctionOptions{Name: name},
+        func(vim *nvim.Nvim, args []interface{}) (interface{}, error) {
+            return handler(nvimClient{vim}, args)
+        })
+}
+
+func loadPlugins() map[string]func(types.Vim)(types.Plugin, error) {
+    plugins := map[string]func(types.Vim)(types.Plugin, error) {
         "c": clangide.CreateCIde, "cpp": clangide.CreateCppIde}
     return plugins
 }
@@ -30,29 +54,64 @@ func main() {
     defer file.Close()
 
     types.LOG = log.New(file, "", log.LstdFlags | log.Lshortfile)
+
+    if len(os.Args) > 1 && os.Args[1] == clangide.WorkerCommand {
+        // the daemon merges the spans of its workers into its trace
+        if os.Getenv("NEOIDE_TRACE") != "" {
+            trace.Start("")
+            trace.NameLane(trace.LaneClang, "clang")
+        }
+        clangide.ServeWorker(os.Stdin, os.Stdout)
+        return
+    }
+
+    if len(os.Args) > 2 && os.Args[1] == ReplayCommand {
+        if err := Replay(os.Args[2], os.Stdout); err != nil {
+            types.LOG.Println(err)
+            os.Stderr.WriteString(err.Error() + "\n")
+            os.Exit(1)
+        }
+        return
+    }
+
     types.LOG.Println("neoide started")
 
+    // the vim plugin passes g:neoide_clang_libclang as NEOIDE_LIBCLANG
+    // without clang workers, so libclang is loaded while the first buffer is
+    // being opened
+    if path := os.Getenv("NEOIDE_LIBCLANG"); path != "" {
+        clangide.Preload(path)
+    }
+
+    // NEOIDE_TRACE=/path/to/trace.json enables tracing
+    if path := os.Getenv("NEOIDE_TRACE"); path != "" {
+        trace.Start(path)
+        trace.NameLane(trace.LaneRpc, "rpc")
+        trace.NameLane(trace.LaneClang, "clang")
+        defer trace.Flush()
+    }
+
+    // NEOIDE_RECORD=/path/to/session.gob.gz records the session, replay it
+    // with neoided --replay /path/to/session.gob.gz
+    var recorder *Recorder
+    if path := os.Getenv("NEOIDE_RECORD"); path != "" {
+        var err error
+        if recorder, err = NewRecorder(path); err != nil {
+            types.LOG.Println(err)
+        } else {
+            defer recorder.Close()
+        }
+    }
+
     neoide := New(loadPlugins())
 
     plugin.Main(func(p *plugin.Plugin) error {
-        p.HandleFunction(
-            &plugin.FunctionOptions{Name: "_neoide_bufenter"},
-            neoide.Enter)
-        p.HandleFunction(
-            &plugin.FunctionOptions{Name: "_neoide_bufsave"},
-            neoide.Save)
-        p.HandleFunction(
-            &plugin.FunctionOptions{Name: "_neoide_bufclose"},
-            neoide.Leave)
-        p.HandleFunction(
-            &plugin.FunctionOptions{Name: "_neoide_find_completions"},
-            neoide.FindCompletions)
-        p.HandleFunction(
-            &plugin.FunctionOptions{Name: "_neoide_show_completions"},
-            neoide.ShowCompletions)
-        p.HandleFunction(
-            &plugin.FunctionOptions{Name: "_neoide_get_completions"},
-            neoide.GetCompletions)
+        for name, handler := range neoide.Handlers() {
+            if recorder != nil {
+                handler = recorder.Wrap(name, handler)
+            }
+            handleFunction(p, name, handler)
+        }
         p.HandleFunction(
             &plugin.FunctionOptions{Name: "_neoide_find_defenition"},
             neoide.FindDefenition)
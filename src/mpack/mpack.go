@@ -0,0 +1,93 @@
+/**
+ * Reflection free MessagePack encoding of the replies sent to vim. Values
+ * are appended to a byte slice which can be reused between the replies.
+ */
+package mpack
+
+import (
+    "sync"
+    "github.com/vbogretsov/neoide/src/types"
+)
+
+var (
+    keyAbbr = AppendString(nil, "abbr")
+    keyWord = AppendString(nil, "word")
+    keyMenu = AppendString(nil, "menu")
+    // the candidates are filtered by neoide, not by vim
+    keyEqual = AppendString(nil, "equal")
+)
+
+var buffers = sync.Pool{
+    New: func() interface{} {
+        buffer := make([]byte, 0, 64 * 1024)
+        return &buffer
+    },
+}
+
+/**
+ * Get an empty buffer from the pool.
+ */
+func Acquire() *[]byte {
+    buffer := buffers.Get().(*[]byte)
+    *buffer = (*buffer)[:0]
+    return buffer
+}
+
+/**
+ * Return the buffer to the pool.
+ */
+func Release(buffer *[]byte) {
+    buffers.Put(buffer)
+}
+
+func appendLength(buf []byte, fix byte, code byte, n int) []byte {
+    switch {
+    case n < 16:
+        return append(buf, fix | byte(n))
+    case n < 1 << 16:
+        return append(buf, code, byte(n >> 8), byte(n))
+    default:
+        return append(
+            buf, code + 1,
+            byte(n >> 24), byte(n >> 16), byte(n >> 8), byte(n))
+    }
+}
+
+func AppendArrayHeader(buf []byte, n int) []byte {
+    return appendLength(buf, 0x90, 0xdc, n)
+}
+
+func AppendMapHeader(buf []byte, n int) []byte {
+    return appendLength(buf, 0x80, 0xde, n)
+}
+
+func AppendString(buf []byte, s string) []byte {
+    n := len(s)
+    switch {
+    case n < 32:
+        buf = append(buf, 0xa0 | byte(n))
+    case n < 1 << 8:
+        buf = append(buf, 0xd9, byte(n))
+    case n < 1 << 16:
+        buf = append(buf, 0xda, byte(n >> 8), byte(n))
+    default:
+        buf = append(
+            buf, 0xdb, byte(n >> 24), byte(n >> 16), byte(n >> 8), byte(n))
+    }
+    return append(buf, s...)
+}
+
+/**
+ * Append vim complete-item dictionary of the completion provided.
+ */
+func AppendCompletion(buf []byte, completion *types.Completion) []byte {
+    buf = AppendMapHeader(buf, 4)
+    buf = append(buf, keyAbbr...)
+    buf = AppendString(buf, completion.Abbr)
+    buf = append(buf, keyWord...)
+    buf = AppendString(buf, completion.Word)
+    buf = append(buf, keyMenu...)
+    buf = AppendString(buf, completion.Menu)
+    buf = append(buf, keyEqual...)
+    return append(buf, 0x01)
+}
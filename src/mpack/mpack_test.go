@@ -0,0 +1,105 @@
+package mpack
+
+import (
+    "bytes"
+    "strings"
+    "testing"
+    "github.com/neovim/go-client/msgpack"
+    "github.com/vbogretsov/neoide/src/types"
+)
+
+func decoder(buf []byte) *msgpack.Decoder {
+    return msgpack.NewDecoder(bytes.NewReader(buf))
+}
+
+func TestAppendString(t *testing.T) {
+    cases := []struct {
+        length int
+        code   byte
+    }{
+        {0, 0xa0}, {31, 0xbf},
+        {32, 0xd9}, {255, 0xd9},
+        {256, 0xda}, {65535, 0xda},
+        {65536, 0xdb},
+    }
+
+    for _, c := range cases {
+        s := strings.Repeat("x", c.length)
+        buf := AppendString(nil, s)
+        if buf[0] != c.code {
+            t.Errorf("string of %d: code 0x%x, expected 0x%x",
+                c.length, buf[0], c.code)
+        }
+
+        d := decoder(buf)
+        if err := d.Unpack(); err != nil {
+            t.Fatalf("string of %d: %v", c.length, err)
+        }
+        if d.Type() != msgpack.String || d.String() != s {
+            t.Errorf("string of %d: decoded %v of %d",
+                c.length, d.Type(), len(d.String()))
+        }
+    }
+}
+
+func TestAppendHeaders(t *testing.T) {
+    cases := []struct {
+        length int
+        array  byte
+        dict   byte
+    }{
+        {0, 0x90, 0x80}, {15, 0x9f, 0x8f},
+        {16, 0xdc, 0xde}, {65535, 0xdc, 0xde},
+        {65536, 0xdd, 0xdf},
+    }
+
+    for _, c := range cases {
+        headers := []struct {
+            buf  []byte
+            code byte
+            kind msgpack.Type
+        }{
+            {AppendArrayHeader(nil, c.length), c.array, msgpack.ArrayLen},
+            {AppendMapHeader(nil, c.length), c.dict, msgpack.MapLen},
+        }
+
+        for _, h := range headers {
+            if h.buf[0] != h.code {
+                t.Errorf("%v of %d: code 0x%x, expected 0x%x",
+                    h.kind, c.length, h.buf[0], h.code)
+            }
+
+            d := decoder(h.buf)
+            if err := d.Unpack(); err != nil {
+                t.Fatalf("%v of %d: %v", h.kind, c.length, err)
+            }
+            if d.Type() != h.kind || d.Len() != c.length {
+                t.Errorf("%v of %d: decoded %v of %d",
+                    h.kind, c.length, d.Type(), d.Len())
+            }
+        }
+    }
+}
+
+func TestAppendCompletion(t *testing.T) {
+    completion := types.Completion{
+        Abbr: "int size() const", Word: "size", Menu: "[clang]"}
+    buf := AppendCompletion(nil, &completion)
+
+    var item map[string]interface{}
+    if err := decoder(buf).Decode(&item); err != nil {
+        t.Fatal(err)
+    }
+
+    expected := map[string]interface{}{
+        "abbr": completion.Abbr, "word": completion.Word,
+        "menu": completion.Menu}
+    for key, value := range expected {
+        if item[key] != value {
+            t.Errorf("%s: %v, expected %v", key, item[key], value)
+        }
+    }
+    if len(item) != 4 || item["equal"] == nil {
+        t.Errorf("unexpected item %v", item)
+    }
+}
@@ -2,31 +2,180 @@ package main
 
 import (
     "errors"
+    "fmt"
     "math/rand"
     "strings"
+    "sync"
+    "time"
+    "github.com/vbogretsov/neoide/src/stats"
+    "github.com/vbogretsov/neoide/src/trace"
     "github.com/vbogretsov/neoide/src/types"
-    "github.com/neovim/go-client/nvim"
 )
 
+var (
+    fetchTime   = stats.NewHistogram("rpc.fetch")
+    quickTime   = stats.NewHistogram("completions.quick")
+    preciseTime = stats.NewHistogram("completions.precise")
+    triggered   = stats.NewCounter("completions.triggered")
+    suppressed  = stats.NewCounter("completions.suppressed")
+    pushed      = stats.NewCounter("completions.pushed")
+)
+
+/**
+ * Plugin recording statistics outside of the daemon process.
+ */
+type statsSource interface {
+    Stats() []stats.Snapshot
+}
+
+/**
+ * Plugin reporting the memory used by the files opened.
+ */
+type memorySource interface {
+    Memory() []types.MemoryUsage
+}
+
+/**
+ * Plugin scheduling background work by the files visible in vim.
+ */
+type visibilitySink interface {
+    Visible(paths []string)
+}
+
+/**
+ * Plugin reading the contents of the files modified and not saved.
+ */
+type bufferSink interface {
+    Changed(path string, content string, modified bool)
+}
+
+/**
+ * Plugin sharing its state with other plugins, the plugins with the same key
+ * report their statistics and memory once.
+ */
+type sharedSource interface {
+    SharedKey() interface{}
+}
+
 type Neoide struct {
-    funcs         map[string]func(*nvim.Nvim)(types.Plugin, error)
+    funcs         map[string]func(types.Vim)(types.Plugin, error)
+    quick         []Source
+    previous      *previousSession
+    background    sync.WaitGroup
+    // guards the plugins loaded and the completion session
+    lock          sync.Mutex
     plugs         map[string]types.Plugin
-    completions   *[]map[string]string
+    session       *Session
+    anchor        *anchor
     completion_id int
 }
 
-func New(funcs map[string]func(*nvim.Nvim)(types.Plugin, error)) *Neoide {
+/**
+ * Completion pushed to vim with complete(). The candidates are filtered by
+ * the word typed since the column and pushed again on every keystroke, so
+ * vim never calls back.
+ */
+type anchor struct {
+    path   string
+    row    int
+    column int
+    word   string
+}
+
+func New(funcs map[string]func(types.Vim)(types.Plugin, error)) *Neoide {
     plugs := make(map[string]types.Plugin)
-    return &Neoide{funcs: funcs, plugs: plugs}
+    return &Neoide{
+        funcs: funcs,
+        plugs: plugs,
+        quick: []Source{bufferWords{}},
+        previous: &previousSession{}}
+}
+
+/**
+ * Wait for the completions running in background.
+ */
+func (ide *Neoide) Wait() {
+    ide.background.Wait()
 }
 
 func (ide *Neoide) Close() {
+    ide.Wait()
+    for _, plug := range ide.plugins() {
+        plug.Close()
+    }
+}
+
+/**
+ * Plugin loaded for the filetype provided.
+ */
+func (ide *Neoide) plug(filetype string) (types.Plugin, bool) {
+    ide.lock.Lock()
+    defer ide.lock.Unlock()
+
+    plug, ok := ide.plug(filetype)
+    return plug, ok
+}
+
+func (ide *Neoide) plugins() []types.Plugin {
+    ide.lock.Lock()
+    defer ide.lock.Unlock()
+
+    result := make([]types.Plugin, 0, len(ide.plugs))
     for _, plug := range ide.plugs {
+        result = append(result, plug)
+    }
+    return result
+}
+
+/**
+ * Load the plugin of the filetype provided unless it is loaded. The plugin
+ * is created unlocked as it calls vim, the one loaded meanwhile wins.
+ */
+func (ide *Neoide) load(vim types.Vim, filetype string) {
+    if _, ok := ide.plug(filetype); ok {
+        return
+    }
+    functor, ok := ide.funcs[filetype]
+    if !ok {
+        return
+    }
+    plug, err := functor(vim)
+    if err != nil {
+        types.LOG.Println(err)
+        return
+    }
+
+    ide.lock.Lock()
+    _, loaded := ide.plugs[filetype]
+    if !loaded {
+        ide.plugs[filetype] = plug
+    }
+    ide.lock.Unlock()
+
+    if loaded {
         plug.Close()
     }
 }
 
-func (ide *Neoide) Enter(vim *nvim.Nvim, args []interface{}) error {
+/**
+ * Plugins loaded, one per shared state.
+ */
+func (ide *Neoide) sources() []types.Plugin {
+    seen := map[interface{}]bool{}
+    result := []types.Plugin{}
+    for _, plug := range ide.plugins() {
+        if shared, ok := plug.(sharedSource); ok {
+            if seen[shared.SharedKey()] {
+                continue
+            }
+            seen[shared.SharedKey()] = true
+        }
+        result = append(result, plug)
+    }
+    return result
+}
+
+func (ide *Neoide) Enter(vim types.Vim, args []interface{}) error {
     filetype, ok := args[0].(string)
     if !ok {
         return errors.New("filetype should be a string")
@@ -36,26 +185,20 @@ func (ide *Neoide) Enter(vim *nvim.Nvim, args []interface{}) error {
     if !ok {
         return errors.New("path should be a string")
     }
+    path = types.AbsPath(path)
 
-    var err error = nil
+    defer trace.Begin("bufenter", "rpc", trace.LaneRpc, path).End()
 
-    if _, ok := ide.plugs[filetype]; !ok {
-        if functor, ok := ide.funcs[filetype]; ok {
-            plug, err := functor(vim)
-            if err == nil {
-                ide.plugs[filetype] = plug
-            }
-        }
-    }
+    ide.load(vim, filetype)
 
-    if plug, ok := ide.plugs[filetype]; ok {
+    if plug, ok := ide.plug(filetype); ok {
         plug.Enter(path, func(){vim.Call("neoide#info", nil, "file ready")})
     }
 
-    return err
+    return nil
 }
 
-func (ide *Neoide) Save(vim *nvim.Nvim, args []interface{}) error {
+func (ide *Neoide) Save(vim types.Vim, args []interface{}) error {
     filetype, ok := args[0].(string)
     if !ok {
         return errors.New("filetype should be a string")
@@ -65,15 +208,40 @@ func (ide *Neoide) Save(vim *nvim.Nvim, args []interface{}) error {
     if !ok {
         return errors.New("path should be a string")
     }
+    path = types.AbsPath(path)
+
+    defer trace.Begin("bufsave", "rpc", trace.LaneRpc, path).End()
+
+    plug, ok := ide.plug(filetype)
+    if !ok {
+        return nil
+    }
 
-    if plug, ok := ide.plugs[filetype]; ok {
-        plug.Save(path, func(){})
+    // files visible in vim, optional
+    if len(args) > 2 {
+        if list, ok := args[2].([]interface{}); ok {
+            visible := make([]string, 0, len(list))
+            for _, item := range list {
+                if path, ok := item.(string); ok {
+                    visible = append(visible, types.AbsPath(path))
+                }
+            }
+            if sink, ok := plug.(visibilitySink); ok {
+                sink.Visible(visible)
+            }
+        }
     }
 
+    plug.Save(path, func(){})
+
     return nil
 }
 
-func (ide *Neoide) Leave(vim *nvim.Nvim, args []interface{}) error {
+/**
+ * Pass the contents of a buffer to the plugin, the contents are nil if the
+ * buffer is not modified.
+ */
+func (ide *Neoide) Changed(vim types.Vim, args []interface{}) error {
     filetype, ok := args[0].(string)
     if !ok {
         return errors.New("filetype should be a string")
@@ -83,46 +251,234 @@ func (ide *Neoide) Leave(vim *nvim.Nvim, args []interface{}) error {
     if !ok {
         return errors.New("path should be a string")
     }
+    path = types.AbsPath(path)
 
-    if plug, ok := ide.plugs[filetype]; ok {
-        plug.Leave(path, func(){})
+    defer trace.Begin("bufchanged", "rpc", trace.LaneRpc, path).End()
+
+    plug, ok := ide.plug(filetype)
+    if !ok {
+        return nil
+    }
+    sink, ok := plug.(bufferSink)
+    if !ok {
+        return nil
     }
 
+    list, modified := args[2].([]interface{})
+    lines := make([]string, 0, len(list))
+    for _, item := range list {
+        if line, ok := item.(string); ok {
+            lines = append(lines, line)
+        }
+    }
+    sink.Changed(path, strings.Join(lines, "\n"), modified)
+
     return nil
 }
 
-func GatherCompletions(
-    vim *nvim.Nvim, column int, plug types.Plugin) *[]map[string]string {
+func (ide *Neoide) Leave(vim types.Vim, args []interface{}) error {
+    filetype, ok := args[0].(string)
+    if !ok {
+        return errors.New("filetype should be a string")
+    }
 
-    batch := vim.NewBatch()
+    path, ok := args[1].(string)
+    if !ok {
+        return errors.New("path should be a string")
+    }
+    path = types.AbsPath(path)
+
+    defer trace.Begin("bufclose", "rpc", trace.LaneRpc, path).End()
+
+    if plug, ok := ide.plug(filetype); ok {
+        plug.Leave(path, func(){})
+    }
 
+    return nil
+}
+
+/**
+ * Fetch the buffer completed in one round trip.
+ */
+func FetchRequest(vim types.Vim, column int) (*Request, error) {
     var path string
     var content []string
     var line int
 
-    batch.Call("expand", &path, "%:p")
-    batch.Call("getline", &content, 1, "$")
-    batch.Call("line", &line, ".")
-    err := batch.Execute()
+    span := trace.Begin("fetch", "rpc", trace.LaneRpc, "")
+    start := time.Now()
+    err := vim.Batch(
+        &types.VimCall{"expand", &path, []interface{}{"%:p"}},
+        &types.VimCall{"getline", &content, []interface{}{1, "$"}},
+        &types.VimCall{"line", &line, []interface{}{"."}})
+    fetchTime.Since(start)
+    span.End()
+
+    if err != nil {
+        return nil, err
+    }
 
-    var completions *[]map[string]string
-    if err == nil {
-        location := &types.Location{path, line, column}
-        text := strings.Join(content, "\n")
-        completions = plug.Complete(text, location)
-    } else {
-        completions = &[]map[string]string{}
+    text := strings.Join(content, "\n")
+    return &Request{types.AbsPath(path), text, line, column}, nil
+}
+
+/**
+ * Complete in two phases. The candidates of the quick sources and of the
+ * previous session are shown at once, the candidates of the plugin replace
+ * the previous session when it answers. Stale answers are dropped. The
+ * candidates are pushed to vim if the anchor is provided, otherwise vim
+ * fetches them through completefunc.
+ */
+func (ide *Neoide) complete(
+    vim types.Vim, column int, push *anchor, plug types.Plugin) {
+
+    start := time.Now()
+
+    request, err := FetchRequest(vim, column)
+    if err != nil {
         vim.Call("neoide#error", nil, err)
+        return
+    }
+    if push != nil {
+        push.path, push.row = request.Path, request.Line
+    }
+
+    lists := make([][]types.Completion, len(ide.quick))
+    for i, source := range ide.quick {
+        lists[i] = source.Complete(request)
     }
+    quick := Merge(append(
+        [][]types.Completion{ide.previous.Complete(request)}, lists...)...)
+
+    completion_id := rand.Int()
+    ide.lock.Lock()
+    ide.completion_id = completion_id
+    ide.session = NewSession(&quick)
+    ide.anchor = push
+    ide.lock.Unlock()
+    quickTime.Since(start)
+
+    if push != nil {
+        ide.push(vim)
+    } else if len(quick) > 0 {
+        vim.Call("neoide#show_popup", nil, column - 1)
+    }
+
+    ide.background.Add(1)
+    go func() {
+        defer ide.background.Done()
+
+        // a newer request came meanwhile, clang is not asked
+        ide.lock.Lock()
+        superseded := completion_id != ide.completion_id
+        ide.lock.Unlock()
+        if superseded {
+            return
+        }
 
-    return completions
+        location := &types.Location{request.Path, request.Line, column}
+        completions := plug.Complete(request.Content, location)
+
+        precise := []types.Completion{}
+        if completions != nil {
+            precise = *completions
+        }
+        ide.previous.Remember(request, precise)
+        merged := Merge(append([][]types.Completion{precise}, lists...)...)
+
+        ide.lock.Lock()
+        if completion_id != ide.completion_id {
+            ide.lock.Unlock()
+            return
+        }
+        ide.session = NewSession(&merged)
+        ide.lock.Unlock()
+        preciseTime.Since(start)
+
+        if push != nil {
+            ide.push(vim)
+        } else {
+            vim.Call("neoide#refresh_popup", nil, column - 1)
+        }
+    }()
+}
+
+/**
+ * Push the candidates of the session matching the word typed to vim.
+ */
+func (ide *Neoide) push(vim types.Vim) {
+    ide.lock.Lock()
+    session, push := ide.session, ide.anchor
+    ide.lock.Unlock()
+
+    if session == nil || push == nil {
+        return
+    }
+
+    pushed.Add(1)
+    vim.Call("neoide#complete", nil, push.column, session.Filter(push.word))
+}
+
+/**
+ * Follow the word typed after a completion was pushed. False if the line is
+ * not the continuation of the word anymore.
+ */
+func (ide *Neoide) follow(vim types.Vim, path string, row int, line string) bool {
+    ide.lock.Lock()
+    push := ide.anchor
+    if push == nil || push.path != path || push.row != row ||
+        push.column - 1 > len(line) {
+        ide.anchor = nil
+        ide.lock.Unlock()
+        return false
+    }
+
+    word := line[push.column - 1:]
+    for i := 0; i < len(word); i++ {
+        if !isWordChar(word[i]) {
+            ide.anchor = nil
+            ide.lock.Unlock()
+            return false
+        }
+    }
+
+    // replaced rather than changed, push reads it unlocked
+    ide.anchor = &anchor{push.path, push.row, push.column, word}
+    ide.lock.Unlock()
+
+    ide.push(vim)
+    return true
+}
+
+/**
+ * Optional flag argument, false if missing.
+ */
+func flag(args []interface{}, i int) bool {
+    if len(args) <= i {
+        return false
+    }
+    switch value := args[i].(type) {
+    case bool:
+        return value
+    case int64:
+        return value != 0
+    case uint64:
+        return value != 0
+    }
+    return false
 }
 
 func (ide *Neoide) GetCompletions(
-    vim *nvim.Nvim, args []interface{}) (*[]map[string]string, error) {
+    vim types.Vim, args []interface{}) (*SessionReply, error) {
+
+    defer trace.Begin("get_completions", "rpc", trace.LaneRpc, "").End()
 
-    if ide.completions == nil {
-        return &[]map[string]string{}, nil
+    ide.lock.Lock()
+    session := ide.session
+    ide.lock.Unlock()
+
+    if session == nil {
+        return &SessionReply{}, nil
     }
 
     word, ok := args[0].(string)
@@ -131,16 +487,12 @@ func (ide *Neoide) GetCompletions(
     }
     word = strings.TrimSpace(word)
 
-    if word == "" {
-        return ide.completions, nil
-    }
-
-    result := Filter(ide.completions, word)
-
-    return result, nil
+    return session.Filter(word), nil
 }
 
-func (ide *Neoide) ShowCompletions(vim *nvim.Nvim, args []interface{}) {
+func (ide *Neoide) ShowCompletions(vim types.Vim, args []interface{}) {
+    defer trace.Begin("show_completions", "rpc", trace.LaneRpc, "").End()
+
     filetype, ok := args[0].(string)
     if !ok {
         vim.Call("neoide#error", nil, "filetype should be a string")
@@ -153,13 +505,19 @@ func (ide *Neoide) ShowCompletions(vim *nvim.Nvim, args []interface{}) {
         return
     }
 
-    if plug, ok := ide.plugs[filetype]; ok {
-        ide.completions = GatherCompletions(vim, int(column), plug)
-        vim.Call("neoide#show_popup", nil, column - 1)
+    plug, ok := ide.plug(filetype)
+    if !ok {
+        return
+    }
+
+    var push *anchor
+    if flag(args, 2) {
+        push = &anchor{column: int(column)}
     }
+    ide.complete(vim, int(column), push, plug)
 }
 
-func (ide *Neoide) FindCompletions(vim *nvim.Nvim, args []interface{}) {
+func (ide *Neoide) FindCompletions(vim types.Vim, args []interface{}) {
 
     filetype, ok := args[0].(string)
     if !ok {
@@ -167,36 +525,119 @@ func (ide *Neoide) FindCompletions(vim *nvim.Nvim, args []interface{}) {
         return
     }
 
-    line, ok := args[1].(string)
+    path, ok := args[1].(string)
+    if !ok {
+        vim.Call("neoide#error", nil, "path should be a string")
+        return
+    }
+    path = types.AbsPath(path)
+
+    row, ok := args[2].(int64)
+    if !ok {
+        vim.Call("neoide#error", nil, "row should be an integer")
+        return
+    }
+
+    line, ok := args[3].(string)
     if !ok {
         vim.Call("neoide#error", nil, "line should be a string")
         return
     }
 
-    plug, ok := ide.plugs[filetype]
+    plug, ok := ide.plug(filetype)
     if !ok {
         return
     }
 
-    column := plug.CanComplete(line)
+    defer trace.Begin("find_completions", "rpc", trace.LaneRpc, path).End()
 
-    if column > 0 {
+    column := plug.CanComplete(&types.Location{path, int(row), 0}, line)
+
+    // push mode, vim does not call back for the candidates
+    push := flag(args, 4)
+
+    if column <= 0 {
+        if !push || !ide.follow(vim, path, int(row), line) {
+            suppressed.Add(1)
+        }
+    } else {
+        triggered.Add(1)
         types.LOG.Printf("getting completions at %d for line %s\n", column, line)
-        completion_id := rand.Int()
-        ide.completion_id = completion_id
-        ide.completions = GatherCompletions(vim, column, plug)
 
-        if completion_id == ide.completion_id {
-            vim.Call("neoide#show_popup", nil, column - 1)
+        var anchored *anchor
+        if push {
+            anchored = &anchor{column: column}
+            if column - 1 <= len(line) {
+                anchored.word = line[column - 1:]
+            }
         }
+        ide.complete(vim, column, anchored, plug)
     }
 }
 
+/**
+ * Write the trace recorded and report its path.
+ */
+func (ide *Neoide) FlushTrace(vim types.Vim, args []interface{}) (string, error) {
+    return trace.Flush()
+}
+
+/**
+ * Report latency percentiles of the completion stages, counters and gauges.
+ */
+func (ide *Neoide) Stats(vim types.Vim, args []interface{}) ([]string, error) {
+    snapshots := stats.Snapshots()
+    for _, plug := range ide.sources() {
+        if source, ok := plug.(statsSource); ok {
+            snapshots = append(snapshots, source.Stats()...)
+        }
+    }
+    return stats.Report(stats.Merge(snapshots)), nil
+}
+
+func megabytes(bytes uint64) string {
+    return fmt.Sprintf("%.1fM", float64(bytes) / (1 << 20))
+}
+
+/**
+ * Report memory used by every file opened, by category, largest first.
+ */
+func (ide *Neoide) Memory(vim types.Vim, args []interface{}) ([]string, error) {
+    lines := []string{fmt.Sprintf(
+        "%8s %8s %8s %8s %8s  %s",
+        "total", "ast", "preamble", "sources", "other", "file")}
+
+    var sum types.MemoryUsage
+    for _, plug := range ide.sources() {
+        source, ok := plug.(memorySource)
+        if !ok {
+            continue
+        }
+        for _, usage := range source.Memory() {
+            lines = append(lines, fmt.Sprintf(
+                "%8s %8s %8s %8s %8s  %s",
+                megabytes(usage.Total()), megabytes(usage.AST),
+                megabytes(usage.Preamble), megabytes(usage.SourceManager),
+                megabytes(usage.Other), usage.Path))
+            sum.AST += usage.AST
+            sum.Preamble += usage.Preamble
+            sum.SourceManager += usage.SourceManager
+            sum.Other += usage.Other
+        }
+    }
+
+    lines = append(lines, fmt.Sprintf(
+        "%8s %8s %8s %8s %8s  %s",
+        megabytes(sum.Total()), megabytes(sum.AST), megabytes(sum.Preamble),
+        megabytes(sum.SourceManager), megabytes(sum.Other), "(total)"))
+    return lines, nil
+}
+
 func (ide *Neoide) FindDefenition(
     filetype string, content string, path string,
     line int, column int) *[]types.Location {
 
-    if plug, ok := ide.plugs[filetype]; ok {
+    if plug, ok := ide.plug(filetype); ok {
         location := &types.Location{path, line, column}
         return plug.FindDefenition(content, location)
     }
@@ -208,7 +649,7 @@ func (ide *Neoide) FindDeclaration(
     filetype string, content string, path string,
     line int, column int) *[]types.Location {
 
-    if plug, ok := ide.plugs[filetype]; ok {
+    if plug, ok := ide.plug(filetype); ok {
         location := &types.Location{path, line, column}
         return plug.FindDeclaration(content, location)
     }
@@ -220,7 +661,7 @@ func (ide *Neoide) FindReferences(
     filetype string, content string, path string,
     line int, column int) *[]types.Location {
 
-    if plug, ok := ide.plugs[filetype]; ok {
+    if plug, ok := ide.plug(filetype); ok {
         location := &types.Location{path, line, column}
         return plug.FindReferences(content, location)
     }
@@ -232,7 +673,7 @@ func (ide *Neoide) FindAssingments(
     filetype string, content string, path string,
     line int, column int) *[]types.Location {
 
-    if plug, ok := ide.plugs[filetype]; ok {
+    if plug, ok := ide.plug(filetype); ok {
         location := &types.Location{path, line, column}
         return plug.FindAssingments(content, location)
     }
@@ -0,0 +1,372 @@
+package main
+
+import (
+    "compress/gzip"
+    "encoding/gob"
+    "errors"
+    "fmt"
+    "io"
+    "os"
+    "reflect"
+    "sort"
+    "sync"
+    "time"
+    "github.com/vbogretsov/neoide/src/stats"
+    "github.com/vbogretsov/neoide/src/types"
+)
+
+const ReplayCommand = "--replay"
+
+/**
+ * RPC handler of the functions exposed to vim.
+ */
+type Handler func(vim types.Vim, args []interface{}) (interface{}, error)
+
+/**
+ * Result of a vim function called while handling a request. Buffer contents
+ * and settings are captured this way.
+ */
+type VimResult struct {
+    Name  string
+    Value interface{}
+    Error string
+}
+
+/**
+ * Request received from vim.
+ */
+type Record struct {
+    Time   int64
+    Method string
+    Args   []interface{}
+    Vim    []VimResult
+}
+
+func init() {
+    gob.Register([]interface{}{})
+    gob.Register(map[string]interface{}{})
+    gob.Register([][]string{})
+}
+
+/**
+ * Handlers of the functions which can be recorded and replayed.
+ */
+func (ide *Neoide) Handlers() map[string]Handler {
+    return map[string]Handler{
+        "_neoide_bufenter": func(
+            vim types.Vim, args []interface{}) (interface{}, error) {
+            return nil, ide.Enter(vim, args)
+        },
+        "_neoide_bufsave": func(
+            vim types.Vim, args []interface{}) (interface{}, error) {
+            return nil, ide.Save(vim, args)
+        },
+        "_neoide_bufchanged": func(
+            vim types.Vim, args []interface{}) (interface{}, error) {
+            return nil, ide.Changed(vim, args)
+        },
+        "_neoide_bufclose": func(
+            vim types.Vim, args []interface{}) (interface{}, error) {
+            return nil, ide.Leave(vim, args)
+        },
+        "_neoide_find_completions": func(
+            vim types.Vim, args []interface{}) (interface{}, error) {
+            ide.FindCompletions(vim, args)
+            return nil, nil
+        },
+        "_neoide_show_completions": func(
+            vim types.Vim, args []interface{}) (interface{}, error) {
+            ide.ShowCompletions(vim, args)
+            return nil, nil
+        },
+        "_neoide_get_completions": func(
+            vim types.Vim, args []interface{}) (interface{}, error) {
+            return ide.GetCompletions(vim, args)
+        },
+        "_neoide_stats": func(
+            vim types.Vim, args []interface{}) (interface{}, error) {
+            return ide.Stats(vim, args)
+        },
+        "_neoide_memory": func(
+            vim types.Vim, args []interface{}) (interface{}, error) {
+            return ide.Memory(vim, args)
+        },
+        "_neoide_trace_flush": func(
+            vim types.Vim, args []interface{}) (interface{}, error) {
+            return ide.FlushTrace(vim, args)
+        },
+    }
+}
+
+/**
+ * Writes the requests handled into a gzip compressed gob stream.
+ */
+type Recorder struct {
+    lock    sync.Mutex
+    file    *os.File
+    zip     *gzip.Writer
+    encoder *gob.Encoder
+    epoch   time.Time
+}
+
+func NewRecorder(path string) (*Recorder, error) {
+    file, err := os.Create(path)
+    if err != nil {
+        return nil, err
+    }
+
+    zip := gzip.NewWriter(file)
+    return &Recorder{
+        file: file,
+        zip: zip,
+        encoder: gob.NewEncoder(zip),
+        epoch: time.Now()}, nil
+}
+
+func (recorder *Recorder) Close() error {
+    recorder.lock.Lock()
+    defer recorder.lock.Unlock()
+
+    if err := recorder.zip.Close(); err != nil {
+        recorder.file.Close()
+        return err
+    }
+    return recorder.file.Close()
+}
+
+/**
+ * Record the requests handled by the handler provided.
+ */
+func (recorder *Recorder) Wrap(name string, handler Handler) Handler {
+    return func(vim types.Vim, args []interface{}) (interface{}, error) {
+        record := &Record{
+            Time: time.Since(recorder.epoch).Nanoseconds(),
+            Method: name,
+            Args: args}
+        recording := &recordingVim{vim: vim, record: record}
+        result, err := handler(recording, args)
+        recording.finish()
+        recorder.write(record)
+        return result, err
+    }
+}
+
+func (recorder *Recorder) write(record *Record) {
+    recorder.lock.Lock()
+    defer recorder.lock.Unlock()
+
+    // flush every record, so the session survives a crash of the daemon
+    err := recorder.encoder.Encode(record)
+    if err == nil {
+        err = recorder.zip.Flush()
+    }
+    if err != nil {
+        types.LOG.Println(err)
+    }
+}
+
+/**
+ * Vim client capturing the results of the calls. The calls made in
+ * background after the request was handled are not captured.
+ */
+type recordingVim struct {
+    lock     sync.Mutex
+    vim      types.Vim
+    record   *Record
+    finished bool
+}
+
+func (vim *recordingVim) finish() {
+    vim.lock.Lock()
+    defer vim.lock.Unlock()
+
+    vim.finished = true
+}
+
+func (vim *recordingVim) capture(name string, result interface{}, err error) {
+    vim.lock.Lock()
+    defer vim.lock.Unlock()
+
+    if vim.finished {
+        return
+    }
+
+    captured := VimResult{Name: name}
+    if err != nil {
+        captured.Error = err.Error()
+    } else if result != nil {
+        captured.Value = reflect.ValueOf(result).Elem().Interface()
+    }
+    vim.record.Vim = append(vim.record.Vim, captured)
+}
+
+func (vim *recordingVim) Call(
+    fname string, result interface{}, args ...interface{}) error {
+
+    err := vim.vim.Call(fname, result, args...)
+    vim.capture(fname, result, err)
+    return err
+}
+
+func (vim *recordingVim) Batch(calls ...*types.VimCall) error {
+    err := vim.vim.Batch(calls...)
+    for _, call := range calls {
+        vim.capture(call.Name, call.Result, err)
+    }
+    return err
+}
+
+/**
+ * Vim client returning the results recorded. The results are matched by the
+ * function name in the order recorded.
+ */
+type replayVim struct {
+    results map[string][]VimResult
+}
+
+func newReplayVim(record *Record) *replayVim {
+    results := make(map[string][]VimResult)
+    for _, result := range record.Vim {
+        results[result.Name] = append(results[result.Name], result)
+    }
+    return &replayVim{results}
+}
+
+func (vim *replayVim) Call(
+    fname string, result interface{}, args ...interface{}) error {
+
+    queue := vim.results[fname]
+    if len(queue) == 0 {
+        return nil
+    }
+    recorded := queue[0]
+    vim.results[fname] = queue[1:]
+
+    if recorded.Error != "" {
+        return errors.New(recorded.Error)
+    }
+    if result == nil || recorded.Value == nil {
+        return nil
+    }
+
+    target := reflect.ValueOf(result).Elem()
+    value := reflect.ValueOf(recorded.Value)
+    if !value.Type().ConvertibleTo(target.Type()) {
+        return fmt.Errorf(
+            "cannot replay %s: %v into %v", fname, value.Type(), target.Type())
+    }
+    target.Set(value.Convert(target.Type()))
+    return nil
+}
+
+func (vim *replayVim) Batch(calls ...*types.VimCall) error {
+    for _, call := range calls {
+        if err := vim.Call(call.Name, call.Result, call.Args...); err != nil {
+            return err
+        }
+    }
+    return nil
+}
+
+func ReadRecords(path string) ([]Record, error) {
+    file, err := os.Open(path)
+    if err != nil {
+        return nil, err
+    }
+    defer file.Close()
+
+    zip, err := gzip.NewReader(file)
+    if err != nil {
+        return nil, err
+    }
+
+    records := []Record{}
+    decoder := gob.NewDecoder(zip)
+    for {
+        var record Record
+        err := decoder.Decode(&record)
+        if err == io.EOF || err == io.ErrUnexpectedEOF {
+            break
+        }
+        if err != nil {
+            return records, err
+        }
+        records = append(records, record)
+    }
+
+    sort.SliceStable(records, func(i, j int) bool {
+        return records[i].Time < records[j].Time
+    })
+    return records, nil
+}
+
+/**
+ * Drive a fresh Neoide with the session recorded and report the latency of
+ * every call and the statistics of the methods and stages. The latency of a
+ * call is reported for its handler and up to the end of its background work,
+ * where clang completes.
+ */
+func Replay(path string, out io.Writer) error {
+    records, err := ReadRecords(path)
+    if err != nil && len(records) == 0 {
+        return err
+    }
+    if err != nil {
+        fmt.Fprintf(out, "session truncated: %v\n", err)
+    }
+
+    neoide := New(loadPlugins())
+    defer neoide.Close()
+
+    handlers := neoide.Handlers()
+    methods := map[string]*stats.Histogram{}
+    totals := map[string]*stats.Histogram{}
+
+    fmt.Fprintf(out, "%6s %-28s %12s %12s\n",
+        "call", "method", "handler", "total")
+
+    for i := range records {
+        record := &records[i]
+        handler, ok := handlers[record.Method]
+        if !ok {
+            fmt.Fprintf(out, "%6d %-28s unknown method\n", i, record.Method)
+            continue
+        }
+
+        histogram, ok := methods[record.Method]
+        if !ok {
+            histogram = stats.NewHistogram("replay" + record.Method)
+            methods[record.Method] = histogram
+            totals[record.Method] = stats.NewHistogram(
+                "replay" + record.Method + ".total")
+        }
+
+        start := time.Now()
+        _, err := handler(newReplayVim(record), record.Args)
+        elapsed := time.Since(start)
+        histogram.Record(elapsed)
+
+        // the completions finish in background, one request at a time
+        neoide.Wait()
+        total := time.Since(start)
+        totals[record.Method].Record(total)
+
+        status := ""
+        if err != nil {
+            status = err.Error()
+        }
+        fmt.Fprintf(out, "%6d %-28s %12v %12v %s\n",
+            i, record.Method, elapsed, total, status)
+    }
+
+    snapshots := stats.Snapshots()
+    for _, plug := range neoide.sources() {
+        if source, ok := plug.(statsSource); ok {
+            snapshots = append(snapshots, source.Stats()...)
+        }
+    }
+    for _, line := range stats.Report(stats.Merge(snapshots)) {
+        fmt.Fprintln(out, line)
+    }
+    return nil
+}
@@ -0,0 +1,80 @@
+package main
+
+import (
+    "time"
+    "github.com/vbogretsov/neoide/src/mpack"
+    "github.com/vbogretsov/neoide/src/stats"
+    "github.com/vbogretsov/neoide/src/trace"
+    "github.com/vbogretsov/neoide/src/types"
+    "github.com/neovim/go-client/msgpack"
+)
+
+var (
+    sessionTime = stats.NewHistogram("session")
+    filterTime  = stats.NewHistogram("filter")
+    encodeTime  = stats.NewHistogram("rpc.encode")
+)
+
+/**
+ * Completion session. Every candidate is encoded once when the session is
+ * created, the replies are assembled from the encoded candidates.
+ */
+type Session struct {
+    items   []types.Completion
+    encoded []byte
+    offsets []int
+}
+
+func NewSession(completions *[]types.Completion) *Session {
+    defer sessionTime.Since(time.Now())
+    defer trace.Begin("session", "rpc", trace.LaneRpc, "").End()
+
+    items := *completions
+    offsets := make([]int, len(items) + 1)
+    encoded := make([]byte, 0, len(items) * 64)
+
+    for i := range items {
+        encoded = mpack.AppendCompletion(encoded, &items[i])
+        offsets[i + 1] = len(encoded)
+    }
+
+    return &Session{items: items, encoded: encoded, offsets: offsets}
+}
+
+/**
+ * Encoded candidate.
+ */
+func (session *Session) Item(i int) []byte {
+    return session.encoded[session.offsets[i]:session.offsets[i + 1]]
+}
+
+/**
+ * Select the candidates matching the word, best first.
+ */
+func (session *Session) Filter(word string) *SessionReply {
+    defer filterTime.Since(time.Now())
+    defer trace.Begin("filter", "rpc", trace.LaneRpc, word).End()
+    return &SessionReply{session, Filter(&session.items, word)}
+}
+
+/**
+ * Candidates of a session selected by the filter.
+ */
+type SessionReply struct {
+    session *Session
+    matches []Match
+}
+
+func (reply *SessionReply) MarshalMsgPack(e *msgpack.Encoder) error {
+    defer encodeTime.Since(time.Now())
+    defer trace.Begin("encode", "rpc", trace.LaneRpc, "").End()
+
+    buffer := mpack.Acquire()
+    defer mpack.Release(buffer)
+
+    *buffer = mpack.AppendArrayHeader(*buffer, len(reply.matches))
+    for _, match := range reply.matches {
+        *buffer = append(*buffer, reply.session.Item(match.Index)...)
+    }
+    return e.PackRaw(*buffer)
+}
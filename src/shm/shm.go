@@ -0,0 +1,210 @@
+/**
+ * Shared memory buffers holding the contents of open files.
+ *
+ * A buffer is a file in /dev/shm mapped by the daemon for writing and by a
+ * clang worker for reading. The header holds the sequence number of the
+ * last write and the contents length, the contents follow the header. The
+ * buffer only grows, so a reader remaps it when the length exceeds its
+ * mapping.
+ */
+package shm
+
+import (
+    "errors"
+    "fmt"
+    "os"
+    "sync"
+    "sync/atomic"
+    "syscall"
+    "unsafe"
+)
+
+const (
+    headerSize  = 16
+    initialSize = 64 * 1024
+)
+
+type Buffer struct {
+    Name    string
+    file    *os.File
+    lock    sync.Mutex
+    data    []byte
+    // mappings replaced while the contents read from them may be in use
+    retired [][]byte
+}
+
+/**
+ * Directory where the buffers are created.
+ */
+func Dir() string {
+    if info, err := os.Stat("/dev/shm"); err == nil && info.IsDir() {
+        return "/dev/shm"
+    }
+    return os.TempDir()
+}
+
+/**
+ * Unique buffer name for the current process.
+ */
+func Name(id int) string {
+    return fmt.Sprintf("%s/neoide-%d-%d", Dir(), os.Getpid(), id)
+}
+
+/**
+ * Create a buffer for writing.
+ */
+func Create(name string) (*Buffer, error) {
+    flags := os.O_RDWR | os.O_CREATE | os.O_EXCL
+    file, err := os.OpenFile(name, flags, 0600)
+    if err != nil {
+        return nil, err
+    }
+
+    buffer := &Buffer{Name: name, file: file}
+    if err := buffer.grow(initialSize); err != nil {
+        buffer.Remove()
+        return nil, err
+    }
+
+    return buffer, nil
+}
+
+/**
+ * Open a buffer created by another process for reading.
+ */
+func Open(name string) (*Buffer, error) {
+    file, err := os.OpenFile(name, os.O_RDONLY, 0)
+    if err != nil {
+        return nil, err
+    }
+
+    buffer := &Buffer{Name: name, file: file}
+    if err := buffer.remap(syscall.PROT_READ); err != nil {
+        buffer.Close()
+        return nil, err
+    }
+
+    return buffer, nil
+}
+
+func (buffer *Buffer) remap(prot int) error {
+    info, err := buffer.file.Stat()
+    if err != nil {
+        return err
+    }
+    if info.Size() < headerSize {
+        return errors.New("shared buffer is truncated: " + buffer.Name)
+    }
+
+    if buffer.data != nil {
+        if prot == syscall.PROT_READ {
+            buffer.retired = append(buffer.retired, buffer.data)
+        } else {
+            syscall.Munmap(buffer.data)
+        }
+        buffer.data = nil
+    }
+
+    data, err := syscall.Mmap(
+        int(buffer.file.Fd()), 0, int(info.Size()), prot, syscall.MAP_SHARED)
+    if err != nil {
+        return err
+    }
+
+    buffer.data = data
+    return nil
+}
+
+func (buffer *Buffer) grow(size int) error {
+    if err := buffer.file.Truncate(int64(size)); err != nil {
+        return err
+    }
+    return buffer.remap(syscall.PROT_READ | syscall.PROT_WRITE)
+}
+
+func (buffer *Buffer) seq() *uint64 {
+    return (*uint64)(unsafe.Pointer(&buffer.data[0]))
+}
+
+func (buffer *Buffer) length() *uint64 {
+    return (*uint64)(unsafe.Pointer(&buffer.data[8]))
+}
+
+/**
+ * Replace the buffer contents. Returns the sequence number of the write.
+ */
+func (buffer *Buffer) Write(content string) (uint64, error) {
+    need := headerSize + len(content)
+
+    if need > len(buffer.data) {
+        size := len(buffer.data)
+        for size < need {
+            size *= 2
+        }
+        if err := buffer.grow(size); err != nil {
+            return 0, err
+        }
+    }
+
+    copy(buffer.data[headerSize:], content)
+    atomic.StoreUint64(buffer.length(), uint64(len(content)))
+    return atomic.AddUint64(buffer.seq(), 1), nil
+}
+
+/**
+ * Sequence number of the last write.
+ */
+func (buffer *Buffer) Seq() uint64 {
+    buffer.lock.Lock()
+    defer buffer.lock.Unlock()
+
+    return atomic.LoadUint64(buffer.seq())
+}
+
+/**
+ * Get the buffer contents written with the sequence number provided. The
+ * slice returned points to the shared memory, it is mapped until the buffer
+ * is closed and holds the contents until the next write.
+ */
+func (buffer *Buffer) Read(seq uint64) ([]byte, error) {
+    buffer.lock.Lock()
+    defer buffer.lock.Unlock()
+
+    if current := atomic.LoadUint64(buffer.seq()); current != seq {
+        return nil, fmt.Errorf(
+            "shared buffer %s is at %d, expected %d",
+            buffer.Name, current, seq)
+    }
+
+    end := headerSize + int(atomic.LoadUint64(buffer.length()))
+    if end > len(buffer.data) {
+        if err := buffer.remap(syscall.PROT_READ); err != nil {
+            return nil, err
+        }
+        if end > len(buffer.data) {
+            return nil, errors.New("shared buffer is truncated: " + buffer.Name)
+        }
+    }
+
+    return buffer.data[headerSize:end], nil
+}
+
+func (buffer *Buffer) Close() {
+    if buffer.data != nil {
+        syscall.Munmap(buffer.data)
+        buffer.data = nil
+    }
+    for _, data := range buffer.retired {
+        syscall.Munmap(data)
+    }
+    buffer.retired = nil
+    buffer.file.Close()
+}
+
+/**
+ * Close the buffer and remove it from the file system.
+ */
+func (buffer *Buffer) Remove() {
+    buffer.Close()
+    os.Remove(buffer.Name)
+}
@@ -0,0 +1,191 @@
+package main
+
+import (
+    "sort"
+    "strings"
+    "sync"
+    "github.com/vbogretsov/neoide/src/types"
+)
+
+const (
+    // Shorter buffer words are not offered.
+    MinWordLength = 3
+    // Rank of the buffer words, worse than most of the clang candidates.
+    WordRank = 40
+    // Rank added to the candidates of the previous session.
+    PreviousPenalty = 10
+)
+
+/**
+ * Completion request passed to the sources.
+ */
+type Request struct {
+    Path    string
+    Content string
+    Line    int
+    Column  int
+}
+
+/**
+ * Offset of the line and column of the request in the content, -1 if out of
+ * the content.
+ */
+func (request *Request) Offset() int {
+    offset := 0
+    for i := 1; i < request.Line; i++ {
+        next := strings.IndexByte(request.Content[offset:], '\n')
+        if next < 0 {
+            return -1
+        }
+        offset += next + 1
+    }
+
+    offset += request.Column - 1
+    if request.Column < 1 || offset > len(request.Content) {
+        return -1
+    }
+    return offset
+}
+
+/**
+ * Text of the line before the column of the request, without indentation.
+ * Empty if the request is out of the content.
+ */
+func (request *Request) Context() string {
+    offset := request.Offset()
+    if offset < 0 {
+        return ""
+    }
+    start := offset - (request.Column - 1)
+    return strings.TrimLeft(request.Content[start:offset], " \t")
+}
+
+/**
+ * Source of completion candidates fast enough to be served before the
+ * completer answers.
+ */
+type Source interface {
+    Complete(request *Request) []types.Completion
+}
+
+func isWordStart(c byte) bool {
+    return c == '_' || (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z')
+}
+
+func isWordChar(c byte) bool {
+    return isWordStart(c) || (c >= '0' && c <= '9')
+}
+
+/**
+ * Identifiers of the buffer, except the one being typed.
+ */
+type bufferWords struct{}
+
+func (bufferWords) Complete(request *Request) []types.Completion {
+    content := request.Content
+    typed := request.Offset()
+
+    seen := map[string]bool{}
+    words := []types.Completion{}
+
+    for i := 0; i < len(content); {
+        if !isWordChar(content[i]) {
+            i++
+            continue
+        }
+
+        start := i
+        for i < len(content) && isWordChar(content[i]) {
+            i++
+        }
+        if start == typed || !isWordStart(content[start]) ||
+            i - start < MinWordLength {
+            continue
+        }
+
+        word := content[start:i]
+        if seen[word] {
+            continue
+        }
+        seen[word] = true
+        words = append(words, types.Completion{
+            Abbr: word, Word: word, Menu: "[buffer]", Rank: WordRank})
+    }
+
+    return words
+}
+
+/**
+ * Candidates of the last completion of a file, served until the completer
+ * answers if the completion is in the same context, like after the same
+ * object or qualifier.
+ */
+type previousSession struct {
+    lock    sync.Mutex
+    path    string
+    context string
+    items   []types.Completion
+}
+
+func (previous *previousSession) Complete(request *Request) []types.Completion {
+    previous.lock.Lock()
+    defer previous.lock.Unlock()
+
+    if previous.path != request.Path ||
+        previous.context != request.Context() {
+        return nil
+    }
+    return previous.items
+}
+
+/**
+ * Keep the candidates of the request provided. The candidates are copied,
+ * the copy is ranked below the fresh ones and never modified.
+ */
+func (previous *previousSession) Remember(
+    request *Request, items []types.Completion) {
+
+    copied := make([]types.Completion, len(items))
+    for i := range items {
+        copied[i] = items[i]
+        copied[i].Rank += PreviousPenalty
+    }
+
+    previous.lock.Lock()
+    defer previous.lock.Unlock()
+
+    previous.path = request.Path
+    previous.context = request.Context()
+    previous.items = copied
+}
+
+/**
+ * Merge the candidate lists by rank. A candidate is dropped if an earlier
+ * list has its word, so the overloads of a list are kept.
+ */
+func Merge(lists ...[]types.Completion) []types.Completion {
+    size := 0
+    for _, list := range lists {
+        size += len(list)
+    }
+
+    merged := make([]types.Completion, 0, size)
+    seen := make(map[string]bool, size)
+
+    for _, list := range lists {
+        start := len(merged)
+        for i := range list {
+            if !seen[list[i].Word] {
+                merged = append(merged, list[i])
+            }
+        }
+        for i := start; i < len(merged); i++ {
+            seen[merged[i].Word] = true
+        }
+    }
+
+    sort.SliceStable(merged, func(i, j int) bool {
+        return merged[i].Rank < merged[j].Rank
+    })
+    return merged
+}
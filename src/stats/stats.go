@@ -0,0 +1,292 @@
+/**
+ * Always-on latency histograms, counters and gauges.
+ *
+ * Histograms use log-linear buckets (16 linear sub-buckets per power of two,
+ * as in HDR histograms), so recording is a single atomic increment and the
+ * relative error of a percentile is below 6.25%. Snapshots of histograms
+ * with the same name can be merged, which is used to collect the numbers of
+ * the worker processes.
+ */
+package stats
+
+import (
+    "fmt"
+    "math/bits"
+    "sort"
+    "sync"
+    "sync/atomic"
+    "time"
+)
+
+const (
+    subBits    = 4
+    subBuckets = 1 << subBits
+    numBuckets = 64 * subBuckets
+)
+
+type Histogram struct {
+    name   string
+    counts [numBuckets]uint64
+    count  uint64
+    sum    uint64
+    max    uint64
+}
+
+type Counter struct {
+    name  string
+    value int64
+}
+
+type Gauge struct {
+    name  string
+    value int64
+}
+
+/**
+ * Histogram values at a moment. Counters and gauges are snapshots without
+ * buckets.
+ */
+type Snapshot struct {
+    Name   string
+    Kind   int
+    Counts []uint64
+    Count  uint64
+    Sum    uint64
+    Max    uint64
+    Value  int64
+}
+
+const (
+    KindHistogram = iota
+    KindCounter   = iota
+    KindGauge     = iota
+)
+
+var (
+    lock       sync.Mutex
+    histograms = []*Histogram{}
+    counters   = []*Counter{}
+    gauges     = []*Gauge{}
+)
+
+func NewHistogram(name string) *Histogram {
+    lock.Lock()
+    defer lock.Unlock()
+
+    histogram := &Histogram{name: name}
+    histograms = append(histograms, histogram)
+    return histogram
+}
+
+func NewCounter(name string) *Counter {
+    lock.Lock()
+    defer lock.Unlock()
+
+    counter := &Counter{name: name}
+    counters = append(counters, counter)
+    return counter
+}
+
+func NewGauge(name string) *Gauge {
+    lock.Lock()
+    defer lock.Unlock()
+
+    gauge := &Gauge{name: name}
+    gauges = append(gauges, gauge)
+    return gauge
+}
+
+func bucket(value uint64) int {
+    if value < subBuckets {
+        return int(value)
+    }
+    shift := bits.Len64(value) - subBits - 1
+    top := value >> uint(shift)
+    return (shift + 1) * subBuckets + int(top - subBuckets)
+}
+
+/**
+ * Highest value of the bucket provided.
+ */
+func bucketValue(index int) uint64 {
+    if index < subBuckets {
+        return uint64(index)
+    }
+    shift := uint(index / subBuckets - 1)
+    top := uint64(index % subBuckets + subBuckets)
+    return ((top + 1) << shift) - 1
+}
+
+func (histogram *Histogram) Record(duration time.Duration) {
+    value := uint64(0)
+    if duration > 0 {
+        value = uint64(duration)
+    }
+
+    atomic.AddUint64(&histogram.counts[bucket(value)], 1)
+    atomic.AddUint64(&histogram.count, 1)
+    atomic.AddUint64(&histogram.sum, value)
+
+    for {
+        max := atomic.LoadUint64(&histogram.max)
+        if value <= max ||
+            atomic.CompareAndSwapUint64(&histogram.max, max, value) {
+            break
+        }
+    }
+}
+
+/**
+ * Record the time elapsed since the start provided.
+ */
+func (histogram *Histogram) Since(start time.Time) {
+    histogram.Record(time.Since(start))
+}
+
+func (counter *Counter) Add(delta int64) {
+    atomic.AddInt64(&counter.value, delta)
+}
+
+func (gauge *Gauge) Add(delta int64) {
+    atomic.AddInt64(&gauge.value, delta)
+}
+
+func (histogram *Histogram) Snapshot() Snapshot {
+    snapshot := Snapshot{
+        Name: histogram.name,
+        Kind: KindHistogram,
+        Counts: make([]uint64, numBuckets),
+        Count: atomic.LoadUint64(&histogram.count),
+        Sum: atomic.LoadUint64(&histogram.sum),
+        Max: atomic.LoadUint64(&histogram.max)}
+
+    for i := range snapshot.Counts {
+        snapshot.Counts[i] = atomic.LoadUint64(&histogram.counts[i])
+    }
+
+    return snapshot
+}
+
+/**
+ * Snapshots of all the histograms, counters and gauges of the process.
+ */
+func Snapshots() []Snapshot {
+    lock.Lock()
+    defer lock.Unlock()
+
+    result := []Snapshot{}
+    for _, histogram := range histograms {
+        result = append(result, histogram.Snapshot())
+    }
+    for _, counter := range counters {
+        result = append(result, Snapshot{
+            Name: counter.name, Kind: KindCounter,
+            Value: atomic.LoadInt64(&counter.value)})
+    }
+    for _, gauge := range gauges {
+        result = append(result, Snapshot{
+            Name: gauge.name, Kind: KindGauge,
+            Value: atomic.LoadInt64(&gauge.value)})
+    }
+    return result
+}
+
+/**
+ * Merge snapshots with the same name and kind.
+ */
+func Merge(snapshots []Snapshot) []Snapshot {
+    index := map[string]int{}
+    result := []Snapshot{}
+
+    for _, snapshot := range snapshots {
+        key := fmt.Sprintf("%d:%s", snapshot.Kind, snapshot.Name)
+        i, ok := index[key]
+        if !ok {
+            if snapshot.Counts != nil {
+                snapshot.Counts = append([]uint64{}, snapshot.Counts...)
+            }
+            index[key] = len(result)
+            result = append(result, snapshot)
+            continue
+        }
+
+        merged := &result[i]
+        for j, count := range snapshot.Counts {
+            merged.Counts[j] += count
+        }
+        merged.Count += snapshot.Count
+        merged.Sum += snapshot.Sum
+        merged.Value += snapshot.Value
+        if snapshot.Max > merged.Max {
+            merged.Max = snapshot.Max
+        }
+    }
+
+    sort.SliceStable(result, func(i, j int) bool {
+        if result[i].Kind != result[j].Kind {
+            return result[i].Kind < result[j].Kind
+        }
+        return result[i].Name < result[j].Name
+    })
+    return result
+}
+
+/**
+ * Value below which the percentage p of the recorded values falls.
+ */
+func (snapshot *Snapshot) Percentile(p float64) time.Duration {
+    if snapshot.Count == 0 {
+        return 0
+    }
+
+    rank := uint64(p / 100 * float64(snapshot.Count) + 0.5)
+    if rank < 1 {
+        rank = 1
+    }
+
+    seen := uint64(0)
+    for i, count := range snapshot.Counts {
+        seen += count
+        if seen >= rank {
+            value := bucketValue(i)
+            if value > snapshot.Max {
+                value = snapshot.Max
+            }
+            return time.Duration(value)
+        }
+    }
+    return time.Duration(snapshot.Max)
+}
+
+/**
+ * Human readable report of the snapshots provided.
+ */
+func Report(snapshots []Snapshot) []string {
+    lines := []string{fmt.Sprintf(
+        "%-20s %8s %10s %10s %10s %10s %10s",
+        "stage", "count", "mean", "p50", "p90", "p99", "max")}
+
+    for i := range snapshots {
+        snapshot := &snapshots[i]
+        switch snapshot.Kind {
+        case KindHistogram:
+            mean := time.Duration(0)
+            if snapshot.Count > 0 {
+                mean = time.Duration(snapshot.Sum / snapshot.Count)
+            }
+            lines = append(lines, fmt.Sprintf(
+                "%-20s %8d %10v %10v %10v %10v %10v",
+                snapshot.Name, snapshot.Count, mean,
+                snapshot.Percentile(50), snapshot.Percentile(90),
+                snapshot.Percentile(99), time.Duration(snapshot.Max)))
+        case KindCounter:
+            lines = append(lines, fmt.Sprintf(
+                "%-20s %8d", snapshot.Name, snapshot.Value))
+        case KindGauge:
+            lines = append(lines, fmt.Sprintf(
+                "%-20s %8d (current)", snapshot.Name, snapshot.Value))
+        }
+    }
+
+    return lines
+}
@@ -0,0 +1,255 @@
+/**
+ * Opt-in request lifecycle tracing in the Chrome trace event format.
+ *
+ * Spans are kept in a ring buffer, so only the latest events are written
+ * when the trace is flushed. The result can be loaded in chrome://tracing
+ * or https://ui.perfetto.dev. Tracing is enabled by Start, until then Begin
+ * returns nil and costs a single check. Other processes, like the clang
+ * workers, are merged into the trace on flush by the sources added.
+ */
+package trace
+
+import (
+    "bufio"
+    "encoding/json"
+    "os"
+    "sync"
+    "sync/atomic"
+    "time"
+)
+
+const Capacity = 1 << 16
+
+/**
+ * Trace lanes (thread ids in the trace viewer).
+ */
+const (
+    LaneRpc   = 1
+    LaneClang = 10
+)
+
+/**
+ * Span recorded, the start is in microseconds since the Unix epoch so that
+ * the events of several processes line up.
+ */
+type Event struct {
+    Name   string
+    Cat    string
+    Tid    int
+    Ts     int64
+    Dur    int64
+    Detail string
+}
+
+/**
+ * Events recorded by a process.
+ */
+type Process struct {
+    Pid    int
+    Name   string
+    Lanes  map[int]string
+    Events []Event
+}
+
+type Span struct {
+    name   string
+    cat    string
+    tid    int
+    start  time.Time
+    detail string
+}
+
+var (
+    lock    sync.Mutex
+    enabled atomic.Bool
+    path    string
+    events  []Event
+    next    int
+    lanes   = map[int]string{}
+    sources = map[int]func() []Process{}
+    added   int
+)
+
+/**
+ * Enable tracing, the trace is written to the path provided on flush.
+ */
+func Start(output string) {
+    lock.Lock()
+    defer lock.Unlock()
+
+    path = output
+    events = make([]Event, 0, Capacity)
+    next = 0
+    enabled.Store(true)
+}
+
+func Enabled() bool {
+    return enabled.Load()
+}
+
+/**
+ * Add a source of the events of other processes, called on flush. Returns
+ * the function removing the source.
+ */
+func AddSource(source func() []Process) func() {
+    lock.Lock()
+    defer lock.Unlock()
+
+    added += 1
+    id := added
+    sources[id] = source
+    return func() {
+        lock.Lock()
+        defer lock.Unlock()
+
+        delete(sources, id)
+    }
+}
+
+/**
+ * Set the name of the lane provided.
+ */
+func NameLane(tid int, name string) {
+    lock.Lock()
+    defer lock.Unlock()
+
+    lanes[tid] = name
+}
+
+/**
+ * Begin a span. The detail is shown in the span arguments.
+ */
+func Begin(name string, cat string, tid int, detail string) *Span {
+    if !enabled.Load() {
+        return nil
+    }
+    return &Span{
+        name: name, cat: cat, tid: tid, start: time.Now(), detail: detail}
+}
+
+func (span *Span) End() {
+    if span == nil {
+        return
+    }
+
+    end := time.Now()
+
+    lock.Lock()
+    defer lock.Unlock()
+
+    e := Event{
+        Name: span.name,
+        Cat: span.cat,
+        Tid: span.tid,
+        Ts: span.start.UnixNano() / 1000,
+        Dur: end.Sub(span.start).Nanoseconds() / 1000,
+        Detail: span.detail}
+
+    if len(events) < Capacity {
+        events = append(events, e)
+    } else {
+        events[next] = e
+    }
+    next = (next + 1) % Capacity
+}
+
+type jsonEvent struct {
+    Name string            `json:"name"`
+    Cat  string            `json:"cat,omitempty"`
+    Ph   string            `json:"ph"`
+    Ts   int64             `json:"ts"`
+    Dur  int64             `json:"dur"`
+    Pid  int               `json:"pid"`
+    Tid  int               `json:"tid"`
+    Args map[string]string `json:"args,omitempty"`
+}
+
+/**
+ * Events recorded by this process, oldest first.
+ */
+func Snapshot() Process {
+    lock.Lock()
+    defer lock.Unlock()
+
+    return snapshot()
+}
+
+func snapshot() Process {
+    process := Process{Pid: os.Getpid(), Lanes: map[int]string{}}
+    for tid, name := range lanes {
+        process.Lanes[tid] = name
+    }
+    // oldest first when the ring has wrapped
+    if len(events) < Capacity {
+        process.Events = append([]Event{}, events...)
+    } else {
+        process.Events = append(
+            append([]Event{}, events[next:]...), events[:next]...)
+    }
+    return process
+}
+
+/**
+ * Write the events recorded and the events of the sources. Returns the path
+ * of the trace written.
+ */
+func Flush() (string, error) {
+    if !enabled.Load() {
+        return "", nil
+    }
+
+    // sources may trace their calls, so they are called unlocked
+    lock.Lock()
+    callbacks := make([]func() []Process, 0, len(sources))
+    for _, source := range sources {
+        callbacks = append(callbacks, source)
+    }
+    lock.Unlock()
+
+    processes := []Process{}
+    for _, source := range callbacks {
+        processes = append(processes, source()...)
+    }
+
+    lock.Lock()
+    defer lock.Unlock()
+
+    file, err := os.Create(path)
+    if err != nil {
+        return "", err
+    }
+    defer file.Close()
+
+    trace := struct {
+        TraceEvents     []jsonEvent `json:"traceEvents"`
+        DisplayTimeUnit string      `json:"displayTimeUnit"`
+    }{[]jsonEvent{}, "ms"}
+
+    for _, process := range append([]Process{snapshot()}, processes...) {
+        if process.Name != "" {
+            trace.TraceEvents = append(trace.TraceEvents, jsonEvent{
+                Name: "process_name", Ph: "M", Pid: process.Pid,
+                Args: map[string]string{"name": process.Name}})
+        }
+        for tid, name := range process.Lanes {
+            trace.TraceEvents = append(trace.TraceEvents, jsonEvent{
+                Name: "thread_name", Ph: "M", Pid: process.Pid, Tid: tid,
+                Args: map[string]string{"name": name}})
+        }
+        for _, e := range process.Events {
+            je := jsonEvent{
+                Name: e.Name, Cat: e.Cat, Ph: "X", Ts: e.Ts, Dur: e.Dur,
+                Pid: process.Pid, Tid: e.Tid}
+            if e.Detail != "" {
+                je.Args = map[string]string{"detail": e.Detail}
+            }
+            trace.TraceEvents = append(trace.TraceEvents, je)
+        }
+    }
+
+    writer := bufio.NewWriter(file)
+    if err := json.NewEncoder(writer).Encode(&trace); err != nil {
+        return "", err
+    }
+    return path, writer.Flush()
+}
@@ -5,12 +5,26 @@
  */
 package types
 
-import "log"
+import (
+    "log"
+    "path/filepath"
+)
 
 var (
     LOG *log.Logger
 )
 
+/**
+ * Absolute clean path of the path provided, the files are keyed by it. The
+ * path is only cleaned if the working directory is unknown.
+ */
+func AbsPath(path string) string {
+    if abs, err := filepath.Abs(path); err == nil {
+        return abs
+    }
+    return filepath.Clean(path)
+}
+
 /**
  * Represents location in a file.
  */
@@ -20,6 +34,51 @@ type Location struct {
     Column int
 }
 
+/**
+ * Represents code completion candidate. Rank is computed by a completer,
+ * lower is better.
+ */
+type Completion struct {
+    Abbr string `msgpack:"abbr"`
+    Word string `msgpack:"word"`
+    Menu string `msgpack:"menu"`
+    Kind byte   `msgpack:"-"`
+    Rank int    `msgpack:"-"`
+}
+
+/**
+ * Memory used by the translation unit of a file in bytes.
+ */
+type MemoryUsage struct {
+    Path          string
+    AST           uint64
+    Preamble      uint64
+    SourceManager uint64
+    Other         uint64
+}
+
+func (usage MemoryUsage) Total() uint64 {
+    return usage.AST + usage.Preamble + usage.SourceManager + usage.Other
+}
+
+/**
+ * Call of a vim function.
+ */
+type VimCall struct {
+    Name   string
+    Result interface{}
+    Args   []interface{}
+}
+
+/**
+ * Vim client.
+ */
+type Vim interface {
+    Call(fname string, result interface{}, args ...interface{}) error
+    // Execute the calls in a single round trip.
+    Batch(calls ...*VimCall) error
+}
+
 type Closable interface {
     Close()
 }
@@ -34,8 +93,8 @@ type FileController interface {
  * Code completer interface.
  */
 type Completer interface {
-    CanComplete(line string) int
-    Complete(content string, location *Location) *[]map[string]string
+    CanComplete(location *Location, line string) int
+    Complete(content string, location *Location) *[]Completion
 }
 
 /**